@@ -0,0 +1,71 @@
+#ifndef DIFFICULTY_H
+#define DIFFICULTY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <endian.h>
+
+/*
+ * Word-level difficulty check for SHA-256 digests.
+ * A difficulty of diff requires the digest, read as a big-endian bit string, to
+ * begin with diff zero bits.  The requirement is turned once per problem into
+ * masks over the digest taken as big-endian 64-bit words, after which checking a
+ * digest is a load, a byte swap and an AND per word, stopping at the first word
+ * with a bit that should be zero but is not.  For difficulties up to 64 that is
+ * a single word.
+ *
+ * The functions are defined here, rather than in a source file, so that they can
+ * be inlined into the search loops.
+ */
+
+struct difficulty {
+    int nwords;         // Words with bits that must be zero (0: unsatisfiable).
+    uint64_t mask[4];   // Bits of each word that must be zero.
+};
+
+/*
+ * Set up the check for a difficulty, given the size of the digests to be checked.
+ * A difficulty of zero, or of more bits than there are in a digest, can never be
+ * satisfied.
+ */
+static inline void difficulty_init(struct difficulty *d, unsigned int diff, size_t dsize) {
+    d->nwords = 0;
+    if(diff == 0 || diff > 8 * dsize || diff > 8 * sizeof(d->mask))
+        return;
+    for(int i = 0; diff > 0; i++) {
+        if(diff >= 64) {
+            d->mask[i] = ~(uint64_t)0;
+            diff -= 64;
+        } else {
+            d->mask[i] = ~(uint64_t)0 << (64 - diff);
+            diff = 0;
+        }
+        d->nwords = i + 1;
+    }
+}
+
+/* Return nonzero if a digest, stored as bytes, satisfies a difficulty. */
+static inline int difficulty_check_digest(const struct difficulty *d, const unsigned char *digest) {
+    for(int i = 0; i < d->nwords; i++) {
+        uint64_t w;
+        __builtin_memcpy(&w, digest + 8 * i, sizeof(w));
+        if(be64toh(w) & d->mask[i])
+            return 0;
+    }
+    return d->nwords != 0;
+}
+
+/*
+ * Return nonzero if the digest given by SHA-256 chaining values satisfies
+ * a difficulty.  This avoids storing the digest as bytes first.
+ */
+static inline int difficulty_check_state(const struct difficulty *d, const uint32_t state[8]) {
+    for(int i = 0; i < d->nwords; i++) {
+        uint64_t w = (uint64_t)state[2 * i] << 32 | state[2 * i + 1];
+        if(w & d->mask[i])
+            return 0;
+    }
+    return d->nwords != 0;
+}
+
+#endif
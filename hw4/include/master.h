@@ -0,0 +1,86 @@
+#ifndef MASTER_H
+#define MASTER_H
+
+/*
+ * Definitions shared by the modules that make up the master process,
+ * beyond those given in polya.h.
+ */
+
+/*
+ * Main-loop implementations available to the master, selected with -m.
+ *   epoll: sleep in epoll_wait() on the result pipes and a signalfd that
+ *     reports changes of state of the workers.
+ *   spin: poll the worker table continuously, with worker state kept up
+ *     to date asynchronously by a SIGCHLD handler.
+ *   threads: no worker processes; problems are solved on a pool of threads
+ *     within the master process instead (see master_threads()).
+ */
+#define MASTER_MODE_EPOLL   0
+#define MASTER_MODE_SPIN    1
+#define MASTER_MODE_THREADS 2
+
+/* The main-loop implementation to be used by master(). */
+extern int master_mode;
+
+/*
+ * Transports over which problems and results are exchanged, selected with -c.
+ *   pipe: a pair of pipes per worker, redirected to its stdin and stdout.
+ *   shm: a pair of rings in a shared-memory segment per worker (see ring.h).
+ */
+#define TRANSPORT_PIPE 0
+#define TRANSPORT_SHM  1
+
+/* The transport to be used between the master and its workers. */
+extern int master_transport;
+
+/*
+ * How the master and an idle worker hand off problems and results, selected
+ * with -H.
+ *   signal: the worker stops itself with SIGSTOP and the master continues it
+ *     with SIGCONT; changes of state are observed through SIGCHLD.
+ *   futex: the worker parks on the futex word in its channel (see ring.h)
+ *     and the master wakes it directly; the worker rings an eventfd of its
+ *     own (its doorbell) when its state changes.  Requires the shm transport.
+ */
+#define HANDOFF_SIGNAL 0
+#define HANDOFF_FUTEX  1
+
+/* The handoff mechanism to be used between the master and its workers. */
+extern int master_handoff;
+
+/*
+ * How worker processes are started, selected with -s.
+ *   exec: each worker executes bin/polya_worker, which initializes all
+ *     solvers afresh; nothing is shared with the master beyond the channel.
+ *   fork: each worker is forked from the master, whose solvers are already
+ *     initialized, and calls worker() directly, sharing the master's code and
+ *     tables copy-on-write.
+ */
+#define MASTER_START_EXEC 0
+#define MASTER_START_FORK 1
+
+/* The way in which master() starts its workers. */
+extern int master_start;
+
+/* The placement of workers on CPUs and nodes, selected with -P (see placement.h). */
+extern int master_placement;
+
+/* Nonzero if the master is to keep a metrics segment, selected with -M (see stats.h). */
+extern int master_metrics;
+
+/* File to which the master records a trace, selected with -R, or NULL (see trace.h). */
+extern char *master_trace;
+
+/*
+ * Run the master in thread mode: solve problems on a pool of threads, one per
+ * worker, each of which runs the solvers directly on its own copy of a problem.
+ * Problems and results are handed between the master thread and the pool
+ * without locks, and the same sf_* events are reported as for worker processes,
+ * with each thread identified by a synthetic ID in place of a PID.
+ *
+ * @param nthreads  Number of threads in the pool.
+ * @return EXIT_SUCCESS or EXIT_FAILURE, as for master().
+ */
+int master_threads(int nthreads);
+
+#endif
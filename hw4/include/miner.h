@@ -0,0 +1,70 @@
+#ifndef MINER_H
+#define MINER_H
+
+#include <stddef.h>
+
+/*
+ * Hashing backends available to the crypto miner, which may be forced with -b.
+ *   auto: try each backend that this processor supports on the first nonces
+ *     of every problem, then continue with the fastest (the default).
+ *   gcrypt: libgcrypt, hashing the whole block for each nonce.
+ *   scalar: in-tree SHA-256 from the block's midstate, in portable C.
+ *   shani: as scalar, using the SHA extensions.
+ *   avx2, avx512: multi-buffer SHA-256 from the midstate, 8 or 16 nonces
+ *     at a time.
+ */
+#define MINER_BACKEND_AUTO   0
+#define MINER_BACKEND_GCRYPT 1
+#define MINER_BACKEND_SCALAR 2
+#define MINER_BACKEND_SHANI  3
+#define MINER_BACKEND_AVX2   4
+#define MINER_BACKEND_AVX512 5
+#define NUM_MINER_BACKENDS   6
+
+/*
+ * Name of the environment variable through which the master passes a forced
+ * backend, by name, to the workers.
+ */
+#define MINER_BACKEND_ENV "POLYA_MINER_BACKEND"
+
+/*
+ * Name of the environment variable through which the master passes the number
+ * of threads with which each worker is to search for a nonce (polya -j), and the
+ * largest number allowed.  The default is a single thread.
+ */
+#define MINER_THREADS_ENV "POLYA_MINER_THREADS"
+#define MINER_MAX_THREADS 64
+
+/*
+ * Look up a crypto miner backend by name.
+ * @return  The backend, or -1 if there is no backend with that name.
+ */
+int miner_backend_lookup(const char *name);
+
+/* Return nonzero if a crypto miner backend can be used on this processor. */
+int miner_backend_supported(int backend);
+
+/*
+ * Measure the rate at which a backend hashes nonces on the calling thread,
+ * for a block and nonce of given sizes, by searching a number of nonces for a
+ * digest that is never found (for benchmarks).
+ *
+ * @param backend  The backend (not MINER_BACKEND_AUTO), which must be supported.
+ * @return  Hashes per second, or 0 if the measurement could not be made.
+ */
+double crypto_miner_hash_rate(int backend, size_t bsize, size_t nsize, long nonces);
+
+/*
+ * Set up chunked work distribution for crypto miner problems (polya -r).
+ * Instead of nvars variants that each start at a different top byte of the
+ * nonce and search until a solution is found, variant var becomes the range of
+ * 2^bits nonces starting at var << bits, and a worker that exhausts its range
+ * returns a failed result so that it can be given the next one.  This is to be
+ * used together with a chunked problem pool (see pool.h).
+ *
+ * @param bits  Log2 of the range size (in [1..62]), or 0 for the default
+ * partitioning.
+ */
+void crypto_miner_set_chunk_bits(int bits);
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * Placement of workers on CPUs and memory nodes, selected with -P.
+ *   none: no placement; the scheduler is free to move workers (the default).
+ *   cores: each worker is bound to one CPU, taking the CPUs available to the
+ *     master in numerical order, and wrapping around if there are more
+ *     workers than CPUs.
+ *   smt-spread: as cores, but the CPUs are taken one hardware thread per
+ *     physical core first, so that no two workers share a core while any
+ *     core is unused.
+ *   numa: the workers are dealt out over the NUMA nodes, each bound to all
+ *     of the available CPUs of its node.
+ * Under every policy but none, a worker's memory, and the shared-memory
+ * channel through which it exchanges problems and results, are allocated
+ * from the node of its CPUs where possible.
+ *
+ * Topology is read from sysfs.  Placement is inherited: the master takes on
+ * the placement of a worker while it starts the worker (whether a process or
+ * a thread) and then reverts to its own.
+ */
+#define PLACEMENT_NONE       0
+#define PLACEMENT_CORES      1
+#define PLACEMENT_SMT_SPREAD 2
+#define PLACEMENT_NUMA       3
+
+/*
+ * Look up a placement policy by name.
+ * @return  The policy, or -1 if there is no policy with that name.
+ */
+int placement_lookup(const char *name);
+
+/*
+ * Work out the placement of each of a number of workers under a policy.
+ * Does nothing for PLACEMENT_NONE.
+ */
+void placement_init(int policy, int nworkers);
+
+/*
+ * Give the calling thread the placement of a worker, so that a process or
+ * thread started from it inherits that placement.
+ */
+void placement_enter(int worker);
+
+/* Return the calling thread to the placement it had before placement_enter(). */
+void placement_leave(void);
+
+/* Allocate a shared memory area used by a worker from the worker's node. */
+void placement_bind(int worker, void *addr, size_t len);
+
+/*
+ * Report the placement of a worker on stderr, identifying it by pid (or by a
+ * synthetic ID for a thread), so that per-worker results can be related to
+ * CPUs and nodes.
+ */
+void placement_report(int worker, pid_t pid);
+
+#endif
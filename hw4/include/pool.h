@@ -0,0 +1,70 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "polya.h"
+
+/*
+ * Problem pool.
+ * This is an alternative to get_problem_variant() and post_result() that
+ * keeps a number of problems open at once, rather than a single current
+ * problem, so that workers can be kept busy on one problem while another
+ * is being finished off.  Every variant handed out by get_pool_variant()
+ * must eventually be returned with post_pool_result(), whether or not
+ * the attempt to solve it succeeded.
+ */
+
+/*
+ * init_problem_pool
+ *
+ * @brief Set up the problem pool.
+ * @details This must be called after init_problems() and before any other
+ * pool function.
+ * @param size  The maximum number of problems to be open at once (at least 1).
+ * @param chunked  If nonzero, each problem hands out an unending sequence of
+ * variants 0, 1, 2, ..., each of which is given to a worker only once, rather
+ * than nvars variants that are handed out again once they have been returned.
+ * This suits problems whose variants are disjoint pieces of work that each
+ * come to an end (see crypto_miner_set_chunk_bits()).
+ */
+void init_problem_pool(int size, int chunked);
+
+/*
+ * get_pool_variant
+ *
+ * @brief Choose a problem variant for an idle worker.
+ * @details New problems are opened as needed to keep the pool full, and
+ * the variant is taken from the unsolved problem with the fewest variants
+ * currently out, so that workers are spread across the open problems.
+ * @param nvars  The number of possible variant forms of a newly opened problem.
+ * @param varp  Set to the variant that was created.
+ * @return  A pointer to the problem, varied in place, or NULL if there is no
+ * variant to hand out at present.  The contents of the problem are only valid
+ * until the next call to get_pool_variant(), but the pointer itself remains
+ * valid, and identifies the problem, until the variant has been returned.
+ */
+struct problem *get_pool_variant(int nvars, int *varp);
+
+/*
+ * post_pool_result
+ *
+ * @brief Return a variant obtained from get_pool_variant(), together with
+ * the result of the attempt to solve it.
+ * @details The result is checked as by post_result(), unless the problem has
+ * already been solved.  A solved problem is freed once all of its variants
+ * have been returned.
+ * @param result  The result to be posted.
+ * @param prob  The problem, as returned by get_pool_variant().
+ * @param var  The variant, as returned by get_pool_variant().
+ * @return 0 if this result solved the problem, otherwise nonzero.
+ */
+int post_pool_result(struct result *result, struct problem *prob, int var);
+
+/*
+ * pool_exhausted
+ *
+ * @return  Nonzero if there are no unsolved problems in the pool and no more
+ * problems are to be generated.
+ */
+int pool_exhausted(void);
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stddef.h>
+#include <signal.h>
+#include <stdatomic.h>
+
+/*
+ * Single-producer, single-consumer ring of variable-length messages, used as
+ * the shared-memory transport between the master and a worker.
+ *
+ * A message is any structure that begins with a size_t giving its total
+ * length, which is true of both struct problem and struct result.  Messages
+ * are stored contiguously (never split across the end of the ring) and aligned
+ * on RING_ALIGN-byte boundaries, so that a consumer can use a message in place
+ * without copying it out of the ring.  When a message will not fit in the space
+ * remaining before the end of the ring, the producer leaves a zero size word
+ * there to tell the consumer to skip back to the beginning.
+ *
+ * head and tail are running byte counts, written only by the producer and the
+ * consumer respectively; each sits on its own cache line.
+ */
+#define RING_ALIGN 16
+
+struct ring {
+    _Alignas(64) _Atomic size_t head;   // Bytes produced so far.
+    _Alignas(64) _Atomic size_t tail;   // Bytes consumed so far.
+    _Alignas(64) size_t cap;            // Size of the data area (a power of two).
+    _Alignas(64) char data[];           // Message storage.
+};
+
+/*
+ * Control block at the start of a channel segment.
+ * In futex handoff mode, handoff holds the WORKER_* state of the worker and
+ * serves as the futex on which an idle worker is parked.  The worker moves it
+ * to WORKER_IDLE (once initialized), WORKER_RUNNING and WORKER_STOPPED; the
+ * master moves it to WORKER_CONTINUED (waking the worker) and back to
+ * WORKER_IDLE once it has taken the result.
+ *
+ * cancel is the worker's cancellation word, which its solver polls in place of
+ * a flag set by a SIGHUP handler.  The master numbers the problems it hands
+ * to each worker with an epoch; it clears the word before it hands over a
+ * problem, and sets it to that problem's epoch to cancel it.  As only the
+ * master writes the word, a cancellation can never outlive the problem it
+ * was meant for.
+ */
+struct channel_ctl {
+    _Alignas(64) _Atomic int handoff;
+    _Alignas(64) volatile sig_atomic_t cancel;
+};
+
+/*
+ * A channel is the pair of rings shared by the master and one worker,
+ * living in a single memfd segment that the worker inherits across exec.
+ */
+struct channel {
+    struct channel_ctl *ctl;
+    struct ring *problems;  // Master to worker.
+    struct ring *results;   // Worker to master.
+    void *base;             // Start of the mapping.
+    size_t len;             // Length of the mapping.
+    int fd;                 // memfd backing the segment.
+};
+
+/* Name of the environment variable through which a worker learns its channel fd. */
+#define CHANNEL_FD_ENV "POLYA_CHANNEL_FD"
+
+/*
+ * Name of the environment variable through which a worker using futex handoff
+ * learns the eventfd on which to notify the master of changes of state.
+ */
+#define DOORBELL_FD_ENV "POLYA_DOORBELL_FD"
+
+/* Default capacity of each ring in a channel, in bytes. */
+#define CHANNEL_RING_SIZE (64 * 1024)
+
+/*
+ * Create a new channel, with rings of (at least) the specified capacity.
+ * The descriptor of the segment is close-on-exec, so a worker has to be
+ * handed it explicitly.
+ * @return 0 if successful, -1 otherwise.
+ */
+int channel_create(struct channel *ch, size_t cap);
+
+/*
+ * Map a channel created by another process, given the file descriptor
+ * of its segment.
+ * @return 0 if successful, -1 otherwise.
+ */
+int channel_attach(struct channel *ch, int fd);
+
+/* Unmap a channel and close its file descriptor. */
+void channel_destroy(struct channel *ch);
+
+/* Return the handoff state of a channel. */
+int channel_state(struct channel *ch);
+
+/* Set the handoff state of a channel. */
+void channel_set_state(struct channel *ch, int state);
+
+/* Cancel the problem with the specified (nonzero) epoch, or clear the cancellation word. */
+void channel_cancel(struct channel *ch, int epoch);
+
+/* Wake a process parked in channel_wait_state() on a channel. */
+void channel_wake(struct channel *ch);
+
+/* Park the caller until the handoff state of a channel becomes the specified state. */
+void channel_wait_state(struct channel *ch, int state);
+
+/*
+ * Producer side: obtain space for a message of the specified size.
+ * @return  A pointer to contiguous space in the ring, or NULL if the ring does
+ * not currently have room.  The message becomes visible to the consumer only
+ * once ring_commit() is called.
+ */
+void *ring_reserve(struct ring *r, size_t size);
+
+/* Producer side: publish a message previously obtained by ring_reserve(). */
+void ring_commit(struct ring *r, size_t size);
+
+/*
+ * Consumer side: return the oldest message in the ring, or NULL if the ring
+ * is empty.  The message remains valid until ring_release() is called.
+ */
+void *ring_peek(struct ring *r);
+
+/* Consumer side: discard the message most recently returned by ring_peek(). */
+void ring_release(struct ring *r);
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * In-tree SHA-256.
+ * Unlike a libgcrypt handle, the hash state is an ordinary structure that
+ * can be saved and restored freely, which lets the crypto miner hash the
+ * constant part of a block once per problem ("midstate") and then hash only
+ * the remainder for each nonce.
+ */
+
+#define SHA256_BLOCK_SIZE  64
+#define SHA256_DIGEST_SIZE 32
+
+/* Chaining values at the start of a hash. */
+extern const uint32_t sha256_initial_state[8];
+
+/* Round constants. */
+extern const uint32_t sha256_k[64];
+
+struct sha256_ctx {
+    uint32_t state[8];                     // Chaining values.
+    uint64_t length;                       // Bytes hashed so far.
+    unsigned char buf[SHA256_BLOCK_SIZE];  // Partial block not yet compressed.
+};
+
+/*
+ * Apply the SHA-256 compression function to a number of consecutive
+ * 64-byte blocks, updating the chaining values in place.
+ */
+void sha256_compress(uint32_t state[8], const unsigned char *blocks, size_t nblocks);
+
+/*
+ * Return nonzero if CPUID reports that this processor has the SHA extensions
+ * (and the SSE levels that sha256_compress_ni() also relies on).
+ */
+int sha256_ni_supported(void);
+
+/* As sha256_compress(), using the SHA extensions. */
+void sha256_compress_ni(uint32_t state[8], const unsigned char *blocks, size_t nblocks);
+
+void sha256_init(struct sha256_ctx *ctx);
+void sha256_update(struct sha256_ctx *ctx, const void *data, size_t len);
+void sha256_final(struct sha256_ctx *ctx, unsigned char digest[SHA256_DIGEST_SIZE]);
+
+/* Length of the final blocks for a message tail of n bytes, once padded. */
+#define SHA256_PADDED_SIZE(n) \
+    ((((n) + 9 + SHA256_BLOCK_SIZE - 1) / SHA256_BLOCK_SIZE) * SHA256_BLOCK_SIZE)
+
+/*
+ * Lay out the final block(s) of a message of msg_len bytes, whose leading
+ * whole blocks have already been compressed: copy the remaining tail_len bytes
+ * of the message to buf (tail may already be in place there), followed by the
+ * padding and the length field.
+ *
+ * @param buf  Area of at least SHA256_PADDED_SIZE(tail_len) bytes.
+ * @return  The number of blocks that were laid out.
+ */
+int sha256_pad(unsigned char *buf, const void *tail, size_t tail_len, uint64_t msg_len);
+
+/* Store chaining values as a big-endian digest. */
+void sha256_digest(const uint32_t state[8], unsigned char digest[SHA256_DIGEST_SIZE]);
+
+/*
+ * Multi-buffer SHA-256: the same final blocks, differing only in some of their
+ * words, are compressed in a number of independent lanes at once, all starting
+ * from a common midstate.  Message words and chaining values are stored
+ * transposed, lane-minor: word i of lane l is at index i * lanes + l.
+ */
+
+/* Largest number of lanes supported by any multi-buffer kernel. */
+#define SHA256_MB_MAX_LANES 16
+
+/*
+ * Return the number of lanes of the widest multi-buffer kernel that this
+ * processor supports, according to CPUID: 16 with AVX-512, 8 with AVX2,
+ * or 0 if there is none.
+ */
+int sha256_mb_lanes(void);
+
+/*
+ * Hash the final blocks in each lane and check the digests against a difficulty.
+ *
+ * @param lanes  Number of lanes, as returned by sha256_mb_lanes().
+ * @param midstate  Chaining values shared by all lanes before the final blocks.
+ * @param words  The big-endian message words of the final blocks, transposed.
+ * @param nblocks  Number of final blocks.
+ * @param diff  Number of leading zero bits required of a digest.
+ * @param state  Area of 8 * lanes words that receives the chaining values of each
+ * lane, transposed, from which a digest can be obtained with sha256_digest().
+ * @return  A mask with bit l set if lane l has a digest with at least diff leading
+ * zero bits.
+ */
+unsigned int sha256_mb_search(int lanes, const uint32_t midstate[8], const uint32_t *words,
+                              int nblocks, unsigned int diff, uint32_t *state);
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+/*
+ * Metrics segment (polya -M).
+ *
+ * The master keeps counters, a histogram of the time from sending a problem to
+ * receiving its result, and the time each worker has spent in each WORKER_*
+ * state, in a POSIX shared-memory object named after its pid.  Workers add the
+ * hashes done by the crypto miner to their own entries.  Each field has a
+ * single writer, and all are updated with relaxed atomic stores, so the segment
+ * can be read at any time (by polya_stat) without any coordination.
+ *
+ * Times are in nanoseconds of CLOCK_MONOTONIC.
+ */
+
+#define STATS_MAGIC   0x706f6c79   // "poly"
+#define STATS_VERSION 1
+
+/* Name of the shared-memory object for a master process, given its pid. */
+#define STATS_NAME_FMT "/polya-stats.%d"
+
+/*
+ * Names of the environment variables through which an exec'd worker learns
+ * the descriptor of the segment and the index of its entry.
+ */
+#define STATS_FD_ENV   "POLYA_STATS_FD"
+#define STATS_SLOT_ENV "POLYA_STATS_SLOT"
+
+/* Number of WORKER_* states, counting the initial state 0. */
+#define STATS_NSTATES 8
+
+/*
+ * Histograms are log-linear, in the manner of HDR histograms: values below
+ * 2^STATS_SUB_BITS have a bucket each, and every power of two above that is
+ * split into 2^STATS_SUB_BITS buckets, so a value is known to within 1/16.
+ */
+#define STATS_SUB_BITS 4
+#define STATS_HIST_BUCKETS ((64 - STATS_SUB_BITS + 1) << STATS_SUB_BITS)
+
+struct stats_histogram {
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum;
+    _Atomic uint64_t max;
+    _Atomic uint64_t buckets[STATS_HIST_BUCKETS];
+};
+
+struct stats_worker {
+    _Alignas(64) _Atomic int pid;           // Process (or synthetic thread) ID, 0 if not started.
+    _Atomic int state;                      // Current WORKER_* state.
+    _Atomic uint64_t state_since;           // When the current state was entered.
+    _Atomic uint64_t state_time[STATS_NSTATES]; // Time spent in each state, not
+                                            // counting the current stay.
+    _Atomic uint64_t dispatched;            // When the current problem was sent, or 0.
+    _Atomic uint64_t results;               // Results received from the worker.
+    _Atomic uint64_t hashes;                // Hashes done by the crypto miner.
+    _Atomic uint64_t hash_time;             // Time the crypto miner spent on them.
+    _Atomic uint64_t last_rate;             // Hashes per second in the latest solve.
+};
+
+struct stats_segment {
+    uint32_t magic;
+    uint32_t version;
+    int32_t master_pid;
+    int32_t nworkers;
+    uint64_t start;                         // When the master started.
+    _Atomic uint64_t dispatched;            // Problems (variants) sent to workers.
+    _Atomic uint64_t solved;                // Results that were not marked failed.
+    _Atomic uint64_t failed;                // Failed results not due to cancellation.
+    _Atomic uint64_t canceled;              // Failed results of canceled problems.
+    struct stats_histogram latency;         // Problem sent to result received.
+    struct stats_worker workers[];
+};
+
+/* Size of the segment for a number of workers. */
+#define STATS_SEGMENT_SIZE(n) (sizeof(struct stats_segment) + (n) * sizeof(struct stats_worker))
+
+/* Histogram bucket of a value. */
+static inline int stats_bucket(uint64_t v) {
+    if(v < (1u << STATS_SUB_BITS))
+        return (int)v;
+    int shift = 63 - __builtin_clzll(v) - STATS_SUB_BITS;
+    return ((shift + 1) << STATS_SUB_BITS) + (int)((v >> shift) & ((1u << STATS_SUB_BITS) - 1));
+}
+
+/* Smallest value in a histogram bucket. */
+static inline uint64_t stats_bucket_value(int b) {
+    if(b < (1 << STATS_SUB_BITS))
+        return b;
+    int shift = (b >> STATS_SUB_BITS) - 1;
+    return ((uint64_t)(1u << STATS_SUB_BITS) + (b & ((1u << STATS_SUB_BITS) - 1))) << shift;
+}
+
+/*
+ * Master side.  Each of these does nothing unless stats_create() has been
+ * called.  Workers are identified by their index in the master's table.
+ */
+
+/*
+ * Create the segment for a number of workers.
+ * @return  The descriptor of the segment (close-on-exec), or -1 on error.
+ */
+int stats_create(int nworkers);
+
+/* Remove the segment. */
+void stats_destroy(void);
+
+/* Return the descriptor of the segment, or -1 if there is none. */
+int stats_fd(void);
+
+void stats_worker_started(int worker, int pid);
+void stats_change_state(int worker, int state);
+void stats_dispatch(int worker);
+void stats_result(int worker, int failed, int canceled);
+
+/*
+ * Worker side.
+ */
+
+/* Map the segment passed by the master to an exec'd worker, if any. */
+void stats_attach(void);
+
+/*
+ * Make the calling thread report as a worker, for a worker that shares the
+ * master's mapping of the segment (forked, or a thread in thread mode).
+ */
+void stats_set_worker(int worker);
+
+/* Account for a number of hashes done by the crypto miner in a given time. */
+void stats_report_hashes(long hashes, double secs);
+
+#endif
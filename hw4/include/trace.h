@@ -0,0 +1,80 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+/*
+ * Trace recorder (polya -R file).
+ *
+ * The master records a timestamped event at each point in the life of a
+ * problem, alongside the sf_* events: the problem is constructed, a variant
+ * is made and sent to a worker, the worker is continued (SIGCONT or a futex
+ * wake), changes state, returns a result that is then posted, and, if it was
+ * canceled, acknowledges the cancellation by returning.
+ *
+ * Events are fixed-size records stored straight into a file mapped shared,
+ * so recording one is a clock read, an atomic increment and a few stores,
+ * is async-signal-safe, and leaves the kernel to write the file back.  The
+ * file is created sparse at its largest size and truncated to the records made when the trace is closed;
+ * the header also counts them, so a trace cut short by a crash can be read.
+ * Events beyond TRACE_MAX_RECORDS are dropped and counted.
+ *
+ * util/polya_trace converts a trace to Chrome trace / Perfetto JSON.
+ */
+
+#define TRACE_MAGIC   0x54796c70   // "plyT"
+#define TRACE_VERSION 1
+#define TRACE_MAX_RECORDS (1 << 22)
+
+/*
+ * Events.  Each has the worker (index in the master's table, or -1), its pid
+ * (or synthetic thread ID), the problem ID and variant where known (-1 where
+ * not), and an argument as noted.
+ */
+#define TRACE_CONSTRUCT  1   // Problem generated; arg = problem type.
+#define TRACE_VARY       2   // Variant made for a worker.
+#define TRACE_SEND       3   // Variant sent to a worker.
+#define TRACE_CONTINUE   4   // Worker continued (SIGCONT or wake).
+#define TRACE_STATE      5   // Change of state; arg = new WORKER_* state.
+#define TRACE_RESULT     6   // Result received; arg = its "failed" field.
+#define TRACE_POST       7   // Result posted; arg = 0 if it solved the problem.
+#define TRACE_CANCEL     8   // Worker notified to cancel.
+#define TRACE_CANCEL_ACK 9   // Result received from a canceled worker.
+#define TRACE_NEVENTS    10
+
+struct trace_record {
+    uint64_t time;          // CLOCK_MONOTONIC, in nanoseconds.
+    uint16_t event;
+    int16_t prob;
+    int32_t var;
+    int32_t worker;
+    int32_t pid;
+    int32_t arg;
+    uint32_t unused;
+};
+
+struct trace_header {
+    uint32_t magic;
+    uint32_t version;
+    int32_t master_pid;
+    int32_t nworkers;
+    uint64_t start_mono;            // CLOCK_MONOTONIC when the trace was opened.
+    uint64_t start_real;            // CLOCK_REALTIME at the same moment.
+    _Atomic uint64_t nrecords;      // Records made (some may have been dropped).
+    uint8_t unused[24];
+};
+
+/*
+ * Create a trace file for a number of workers.
+ * @return 0 if successful, otherwise -1.
+ */
+int trace_open(const char *path, int nworkers);
+
+/* Finish the trace file, if one is open. */
+void trace_close(void);
+
+/* Record an event, if a trace is open. */
+void trace_event(int event, int worker, int pid, int prob, int var, int arg);
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef WORKER_H
+#define WORKER_H
+
+#include "polya.h"
+
+/*
+ * Definitions shared by worker processes and the master's thread mode,
+ * beyond those given in polya.h.
+ */
+
+/*
+ * Run the solver for a problem, and make a result of whatever it returns.
+ * A solver that fails, or is canceled, gets a result that consists of just
+ * a header marked "failed".
+ *
+ * @param prob  The problem, which the solver may vary in place.
+ * @param canceledp  Cancellation flag to be polled by the solver.
+ * @return  The result, in storage obtained from malloc.
+ */
+struct result *solve_problem(struct problem *prob, volatile sig_atomic_t *canceledp);
+
+#endif
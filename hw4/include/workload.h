@@ -0,0 +1,57 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+/*
+ * Settings of the problems generated by the master, beyond the number of
+ * problems given to init_problems().  These must be made before
+ * init_problems() is called.
+ *
+ * Given the same seed and settings, the master generates the same sequence
+ * of problems, whatever the number of workers, mode or timing, so that a run
+ * can be replayed exactly when comparing one change with another.
+ *
+ * Distributions of integers are given as a comma-separated list of items,
+ * each a value or an inclusive range "lo-hi", optionally followed by
+ * ":weight" (default 1).  An item is chosen with probability in proportion to
+ * its weight, then a value uniformly from its range.  For example, "32" is
+ * always 32, "20-25" is uniform from 20 to 25, and "32:3,64-128" is 32 three
+ * times in four, otherwise uniform from 64 to 128.
+ */
+
+/* Most items in a distribution. */
+#define WORKLOAD_MAX_ITEMS 32
+
+/* Limits on the parameters of crypto miner problems. */
+#define WORKLOAD_MAX_BSIZE 4096
+#define WORKLOAD_MAX_NSIZE 32
+#define WORKLOAD_MAX_DIFF  64
+
+/*
+ * Seed the random generation of problems (polya -S), so that a run can be
+ * repeated with the same sequence of problems.  Without a seed, the time of
+ * day is used.
+ */
+void workload_set_seed(unsigned int seed);
+
+/*
+ * Set the distributions of the block size (polya -B, default "32"), nonce
+ * size (polya -N, default "8") and difficulty (polya -d, default "20-25") of
+ * crypto miner problems.
+ * @return 0 if the distribution is valid, otherwise -1.
+ */
+int workload_set_block_size(const char *spec);
+int workload_set_nonce_size(const char *spec);
+int workload_set_difficulty(const char *spec);
+
+/*
+ * Set the mix of problem types (polya -T), as a distribution of type numbers,
+ * for example "1:3,2" for three trivial problems to each crypto miner problem.
+ * Without a mix, each type enabled with -t is equally likely.
+ *
+ * @param maskp  Bits for the types in the mix are added to the mask of
+ * enabled types (see init_problems()).
+ * @return 0 if the mix is valid, otherwise -1.
+ */
+int workload_set_type_mix(const char *spec, unsigned int *maskp);
+
+#endif
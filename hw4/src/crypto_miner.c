@@ -10,10 +10,17 @@
 
 #include <stdio.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/time.h>
 #include <gcrypt.h>
 
 #include "debug.h"
 #include "polya.h"
+#include "sha256.h"
+#include "miner.h"
+#include "difficulty.h"
+#include "stats.h"
 
 /*
  * Format of a crypto miner problem.
@@ -29,6 +36,7 @@ struct crypto_miner_problem {
     int bsize;          // Size of the block, in bytes.
     int nsize;          // Size of a nonce, in bytes.
     short diff;         // Difficulty level to be satisfied.
+    short cbits;        // Log2 of the number of nonces to try, or 0 for all of them.
     char data[0];       // Data: block, followed by starting nonce.
 };
 
@@ -57,7 +65,7 @@ static int crypto_miner_check_result(struct result *aresult, struct problem *apr
 
 static int solve(char *block, size_t bsize,
 		 unsigned char *nonce, size_t nsize, unsigned int diff,
-		 volatile sig_atomic_t *cancelp);
+		 volatile sig_atomic_t *cancelp, long limit);
 static int check_result(unsigned char *digest, size_t dsize, unsigned int diff);
 static void init_nonce(unsigned char *nonce, size_t nsize);
 static int update_nonce(unsigned char *nonce, size_t nsize);
@@ -74,6 +82,16 @@ void crypto_miner_solver_init(void) {
     solvers[CRYPTO_MINER_PROBLEM_TYPE] = crypto_miner_solver_methods;
 }
 
+/*
+ * Log2 of the size of the nonce ranges handed out as variants in chunked mode,
+ * or 0 if variants are formed by partitioning on the top byte of the nonce.
+ */
+static int chunk_bits;
+
+void crypto_miner_set_chunk_bits(int bits) {
+    chunk_bits = bits;
+}
+
 /*
  * Create a "crypto miner problem" from given parameters.
  * Returns a pointer to the constructed problem.  Caller must free.
@@ -102,8 +120,7 @@ static struct problem *crypto_miner_construct_problem
     prob->id = id;
     prob->bsize = bsize;
     prob->nsize = nsize;
-    // Random difficulty 20 to diff.
-    prob->diff = diff <= 20 ? 20 : 20 + random() % (diff - 20 + 1);
+    prob->diff = diff;
     // Copy the block data into the problem.
     memcpy(prob->data, block, bsize);
     return (struct problem *)prob;
@@ -120,6 +137,21 @@ static struct problem *crypto_miner_construct_problem
  */
 static void crypto_miner_vary_problem(struct problem *aprob, int var) {
     struct crypto_miner_problem *prob = (struct crypto_miner_problem *)aprob;
+    if(chunk_bits) {
+	// In chunked mode, variant var is instead the var-th range of 2^chunk_bits
+	// nonces, so the starting nonce is var << chunk_bits (modulo the size of the
+	// nonce space), stored least-significant byte first.
+	unsigned char *nonce = (unsigned char *)prob->data + prob->bsize;
+	memset(nonce, 0, prob->nsize);
+	for(int i = 0; i < 8 * sizeof(var); i++) {
+	    int bit = chunk_bits + i;
+	    if((var >> i) & 1 && bit < 8 * prob->nsize)
+		nonce[bit / 8] |= 1 << (bit % 8);
+	}
+	prob->var = var;
+	prob->cbits = chunk_bits;
+	return;
+    }
     // Initialize the starting nonce according to the specified variant.
     // Specifically, we clear the nonce and initialize the most-significant byte
     // to a value associated with the desired variant.
@@ -161,13 +193,16 @@ static struct result *crypto_miner_solver(struct problem *aprob, volatile sig_at
     unsigned char *nonce = malloc(prob->nsize);
     // Copy initial nonce from the problem data.
     memcpy(nonce, prob->data + prob->bsize, prob->nsize);
-    switch(failed = solve(prob->data, prob->bsize, nonce, prob->nsize, prob->diff, canceledp)) {
+    long limit = prob->cbits ? 1L << prob->cbits : -1;
+    switch(failed = solve(prob->data, prob->bsize, nonce, prob->nsize, prob->diff, canceledp,
+			  limit)) {
     case -1:
 	// Solving was canceled.
 	free(nonce);
 	return NULL;
     case 1:
-	// The space of possible nonce values was exhausted without finding a solution.
+	// The space (or range) of possible nonce values was exhausted without
+	// finding a solution.
 	free(nonce);
 	return NULL;
     case 0:
@@ -235,30 +270,115 @@ static int crypto_miner_check_result(struct result *aresult, struct problem *apr
 }
 
 /*
- * This function attempts to "solve" a block by iterating through a space of nonces.
- * For each nonce, the concatenation of the block and the nonce is hashed, and the resulting
- * digest is checked to see if it has the characteristics required of a solution.
+ * Return codes of the search engines used by solve(), in addition to those of
+ * solve() itself: the engine stopped after the requested number of iterations,
+ * leaving the next nonce to be tried in the caller's nonce area.
+ */
+#define SEARCH_LIMIT 2
+
+/*
+ * Number of nonces tried with each search engine when solve() is deciding which
+ * of them is faster for a particular block.
+ */
+#define SOLVE_CALIBRATION_ITERS 16384
+
+/*
+ * Advance a nonce to the next value, as update_nonce() does.
+ * The nonce is a little-endian counter, so for the common widths it can be
+ * incremented as native integers instead of a byte at a time.  When nsize is a
+ * compile-time constant, all but one case of the switch is compiled away.
+ */
+static inline __attribute__((always_inline)) int next_nonce(unsigned char *nonce, size_t nsize)
+{
+    switch(nsize) {
+    case 4:
+	{
+	    uint32_t n;
+	    memcpy(&n, nonce, sizeof(n));
+	    n = htole32(le32toh(n) + 1);
+	    memcpy(nonce, &n, sizeof(n));
+	    return n != 0;
+	}
+    case 8:
+	{
+	    uint64_t n;
+	    memcpy(&n, nonce, sizeof(n));
+	    n = htole64(le64toh(n) + 1);
+	    memcpy(nonce, &n, sizeof(n));
+	    return n != 0;
+	}
+    case 16:
+	{
+	    uint64_t lo, hi;
+	    memcpy(&lo, nonce, sizeof(lo));
+	    lo = le64toh(lo) + 1;
+	    memcpy(nonce, &(uint64_t){ htole64(lo) }, sizeof(lo));
+	    if(lo != 0)
+		return 1;
+	    memcpy(&hi, nonce + 8, sizeof(hi));
+	    hi = le64toh(hi) + 1;
+	    memcpy(nonce + 8, &(uint64_t){ htole64(hi) }, sizeof(hi));
+	    return hi != 0;
+	}
+    default:
+	return update_nonce(nonce, nsize);
+    }
+}
+
+/*
+ * Body of a search engine that calls an always-inline search function, with
+ * a constant nonce size for each of the widths that next_nonce() handles
+ * natively, so that a specialized copy of the search loop is compiled for each.
+ * Other widths use the generic copy.  Any further arguments are passed on.
+ */
+#define SEARCH_SPECIALIZED(search, ...) do {					\
+	switch(nsize) {								\
+	case 4:									\
+	    return search(block, bsize, nonce, 4, diff, canceledp, limit, iterp, ##__VA_ARGS__); \
+	case 8:									\
+	    return search(block, bsize, nonce, 8, diff, canceledp, limit, iterp, ##__VA_ARGS__); \
+	case 16:								\
+	    return search(block, bsize, nonce, 16, diff, canceledp, limit, iterp, ##__VA_ARGS__); \
+	default:								\
+	    return search(block, bsize, nonce, nsize, diff, canceledp, limit, iterp, ##__VA_ARGS__); \
+	}									\
+    } while(0)
+
+static void report_solution(unsigned char *x, size_t dsize, long iter)
+{
+    char hex[] = { '0', '1', '2', '3', '4', '5', '6', '7',
+		   '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
+    char *buf;
+    debug("[%d:Worker] Solution found at iteration %lu", getpid(), iter);
+    buf = malloc(2*dsize+1);
+    for(int i = 0; i < dsize; i++) {
+	buf[2*i] = hex[x[i] & 0xf];
+	buf[2*i+1] = hex[(x[i] >> 4) & 0xf];
+    }
+    buf[2*dsize] = '\0';
+    debug("[%d:Worker] %s", getpid(), buf);
+    free(buf);
+}
+
+/*
+ * Search engine that hashes the whole of the block and the nonce with libgcrypt
+ * for each nonce.
  *
- * @param block  Pointer to the block to be solved.
- * @param bsize  Size of the block in bytes.
- * @param nonce  Pointer to an area where the nonce is to be stored.
- * @param nsize  Size of the nonce in bytes.
- * @param diff  The "difficulty" to be satisfied.  A digest satisfies the difficulty if
- * it has this many leading zero bits.
- * @param canceledp  Pointer to a flag which, if set, indicates that the current solution attempt
- * should be abandoned.
- * @return 0 if a solution is found, 1 if the space of possible nonces is exhausted without
- * finding any solution, -1 if solving was canceled.
+ * @param limit  Maximum number of nonces to try, or -1 for no limit.
+ * @param iterp  Running count of nonces tried, updated by the search.
+ * @return  As for solve(), or SEARCH_LIMIT if the limit was reached.
  */
-static int solve(char *block, size_t bsize,
-		 unsigned char *nonce, size_t nsize, unsigned int diff,
-		 volatile sig_atomic_t *canceledp)
+static inline __attribute__((always_inline)) int search_gcrypt_sized
+	(char *block, size_t bsize,
+	 unsigned char *nonce, size_t nsize, unsigned int diff,
+	 volatile sig_atomic_t *canceledp, long limit, long *iterp)
 {
-    long iter = 0;
     unsigned char *x;
     size_t dsize;
     gcry_md_hd_t h;
+    struct difficulty target;
     dsize = gcry_md_get_algo_dlen(GCRY_MD_SHA256);  // get the digest length
+    difficulty_init(&target, diff, dsize);
     gcry_md_open(&h, GCRY_MD_SHA256, GCRY_MD_FLAG_SECURE);
     if(h == NULL) {
 	debug("[%d:Worker] gcry_md_open failed", getpid());
@@ -266,36 +386,543 @@ static int solve(char *block, size_t bsize,
     }
     do {
 	if(*canceledp) {
-	    debug("[%d:Worker] Crypto miner solver canceled", getpid());
 	    gcry_md_close(h);
 	    return -1;
 	}
-	iter++;
+	if(limit-- == 0) {
+	    gcry_md_close(h);
+	    return SEARCH_LIMIT;
+	}
+	(*iterp)++;
 	gcry_md_write(h, block, bsize); // hash the block
 	gcry_md_write(h, nonce, nsize); // hash the nonce
 	x = gcry_md_read(h, GCRY_MD_SHA256); // get the result
-	if(check_result(x, dsize, diff)) {
-	    char hex[] = { '0', '1', '2', '3', '4', '5', '6', '7',
-                           '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
-	    char *buf;
-	    debug("[%d:Worker] Solution found at iteration %lu", getpid(), iter);
-	    buf = malloc(2*dsize+1);
-	    for(int i = 0; i < dsize; i++) {
-		buf[2*i] = hex[x[i] & 0xf];
-		buf[2*i+1] = hex[(x[i] >> 4) & 0xf];
-	    }
-	    buf[2*dsize] = '\0';
-	    debug("[%d:Worker] %s", getpid(), buf);
-	    free(buf);
+	if(difficulty_check_digest(&target, x)) {
+	    report_solution(x, dsize, *iterp);
 	    gcry_md_close(h);
 	    return 0;
 	}
 	gcry_md_reset(h);
-    } while(update_nonce(nonce, nsize));
-    debug("[%d:Worker] No solution found after %lu iterations", getpid(), iter);
+    } while(next_nonce(nonce, nsize));
+    gcry_md_close(h);
     return 1;
 }
 
+static int search_gcrypt(char *block, size_t bsize,
+			 unsigned char *nonce, size_t nsize, unsigned int diff,
+			 volatile sig_atomic_t *canceledp, long limit, long *iterp)
+{
+    SEARCH_SPECIALIZED(search_gcrypt_sized);
+}
+
+/*
+ * Search engines that use the in-tree SHA-256, with the compression function
+ * in portable C or with the SHA extensions.
+ * The block is constant for the whole search, so the hash state after its leading
+ * full 64-byte chunks (the "midstate") is computed just once.  For each nonce, only
+ * the final blocks -- the rest of the block, the nonce and the padding, which are laid
+ * out once in a buffer in which the nonce is then updated in place -- are compressed.
+ *
+ * Arguments and return value are as for search_gcrypt(), with the compression
+ * function to be used as an additional argument.
+ */
+static inline __attribute__((always_inline)) int search_midstate(char *block, size_t bsize,
+			   unsigned char *nonce, size_t nsize, unsigned int diff,
+			   volatile sig_atomic_t *canceledp, long limit, long *iterp,
+			   void (*compress)(uint32_t *, const unsigned char *, size_t))
+{
+    unsigned char x[SHA256_DIGEST_SIZE];
+    size_t dsize = SHA256_DIGEST_SIZE;
+    uint32_t midstate[8], state[8];
+    size_t prefix = bsize - bsize % SHA256_BLOCK_SIZE;
+    size_t tail = bsize - prefix;
+    unsigned char *final = malloc(SHA256_PADDED_SIZE(tail + nsize));
+    if(final == NULL) {
+	debug("[%d:Worker] Unable to allocate hash buffer", getpid());
+	abort();
+    }
+    struct difficulty target;
+    difficulty_init(&target, diff, dsize);
+    memcpy(midstate, sha256_initial_state, sizeof(midstate));
+    compress(midstate, (unsigned char *)block, prefix / SHA256_BLOCK_SIZE);
+    // Lay out the final blocks: the rest of the block, then the starting nonce
+    // (which is updated in place from then on), then the padding.
+    memcpy(final, block + prefix, tail);
+    memcpy(final + tail, nonce, nsize);
+    int nfinal = sha256_pad(final, final, tail + nsize, bsize + nsize);
+    unsigned char *fnonce = final + tail;
+    int ret;
+    do {
+	if(*canceledp) {
+	    ret = -1;
+	    goto out;
+	}
+	if(limit-- == 0) {
+	    ret = SEARCH_LIMIT;
+	    goto out;
+	}
+	(*iterp)++;
+	memcpy(state, midstate, sizeof(state));
+	compress(state, final, nfinal);
+	if(difficulty_check_state(&target, state)) {
+	    sha256_digest(state, x);
+	    report_solution(x, dsize, *iterp);
+	    ret = 0;
+	    goto out;
+	}
+    } while(next_nonce(fnonce, nsize));
+    ret = 1;
+ out:
+    memcpy(nonce, fnonce, nsize);
+    free(final);
+    return ret;
+}
+
+static int search_scalar(char *block, size_t bsize,
+			 unsigned char *nonce, size_t nsize, unsigned int diff,
+			 volatile sig_atomic_t *canceledp, long limit, long *iterp)
+{
+    SEARCH_SPECIALIZED(search_midstate, sha256_compress);
+}
+
+static int search_shani(char *block, size_t bsize,
+			unsigned char *nonce, size_t nsize, unsigned int diff,
+			volatile sig_atomic_t *canceledp, long limit, long *iterp)
+{
+    SEARCH_SPECIALIZED(search_midstate, sha256_compress_ni);
+}
+
+static uint32_t load_be32(const unsigned char *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/*
+ * Search engine that runs the midstate search on a multi-buffer SHA-256 kernel,
+ * trying as many consecutive nonces at once as the kernel has lanes.
+ * The final blocks are laid out once as for search_midstate() and transposed into
+ * lane-wise message words; only the words that overlap the nonce differ between
+ * lanes and need to be refreshed on each pass.  Lanes are examined in nonce order
+ * and each candidate digest is confirmed with difficulty_check_state(), so the solution found
+ * is exactly the one that search_midstate() would find.
+ *
+ * Arguments and return value are as for search_gcrypt(), with the number of lanes
+ * as an additional argument; the limit may be exceeded by less than one pass.
+ */
+static inline __attribute__((always_inline)) int search_multibuffer(char *block, size_t bsize,
+			      unsigned char *nonce, size_t nsize, unsigned int diff,
+			      volatile sig_atomic_t *canceledp, long limit, long *iterp,
+			      int lanes)
+{
+    unsigned char x[SHA256_DIGEST_SIZE];
+    uint32_t midstate[8], state[8 * SHA256_MB_MAX_LANES], lstate[8];
+    size_t prefix = bsize - bsize % SHA256_BLOCK_SIZE;
+    size_t tail = bsize - prefix;
+    size_t fsize = SHA256_PADDED_SIZE(tail + nsize);
+    unsigned char *final = malloc(fsize);
+    unsigned char *base = malloc(nsize);
+    uint32_t *words = malloc(fsize / 4 * lanes * sizeof(uint32_t));
+    if(final == NULL || base == NULL || words == NULL) {
+	debug("[%d:Worker] Unable to allocate hash buffers", getpid());
+	abort();
+    }
+    struct difficulty target;
+    difficulty_init(&target, diff, SHA256_DIGEST_SIZE);
+    memcpy(midstate, sha256_initial_state, sizeof(midstate));
+    sha256_compress(midstate, (unsigned char *)block, prefix / SHA256_BLOCK_SIZE);
+    memcpy(final, block + prefix, tail);
+    memcpy(final + tail, nonce, nsize);
+    int nfinal = sha256_pad(final, final, tail + nsize, bsize + nsize);
+    unsigned char *fnonce = final + tail;
+    size_t first = tail / 4, last = (tail + nsize - 1) / 4;
+    for(size_t i = 0; i < fsize / 4; i++) {
+	for(int l = 0; l < lanes; l++)
+	    words[i * lanes + l] = load_be32(final + 4 * i);
+    }
+    int ret;
+    for(;;) {
+	if(*canceledp) {
+	    ret = -1;
+	    goto out;
+	}
+	if(limit == 0) {
+	    ret = SEARCH_LIMIT;
+	    goto out;
+	}
+	if(limit > 0)
+	    limit -= limit < lanes ? limit : lanes;
+	// Give each lane the next nonce in turn.  Should the nonce space run
+	// out part way through, the remaining lanes are ignored.
+	int valid = lanes, exhausted = 0;
+	memcpy(base, fnonce, nsize);
+	for(int l = 0; l < lanes; l++) {
+	    for(size_t i = first; i <= last; i++)
+		words[i * lanes + l] = load_be32(final + 4 * i);
+	    if(!next_nonce(fnonce, nsize)) {
+		valid = l + 1;
+		exhausted = 1;
+		break;
+	    }
+	}
+	unsigned int hits = sha256_mb_search(lanes, midstate, words, nfinal, diff, state);
+	for(int l = 0; l < valid; l++) {
+	    if(!(hits & (1u << l)))
+		continue;
+	    for(int i = 0; i < 8; i++)
+		lstate[i] = state[i * lanes + l];
+	    if(difficulty_check_state(&target, lstate)) {
+		sha256_digest(lstate, x);
+		*iterp += l + 1;
+		report_solution(x, SHA256_DIGEST_SIZE, *iterp);
+		memcpy(fnonce, base, nsize);
+		while(l--)
+		    next_nonce(fnonce, nsize);
+		ret = 0;
+		goto out;
+	    }
+	}
+	*iterp += valid;
+	if(exhausted) {
+	    ret = 1;
+	    goto out;
+	}
+    }
+ out:
+    memcpy(nonce, fnonce, nsize);
+    free(words);
+    free(base);
+    free(final);
+    return ret;
+}
+
+static int search_avx2(char *block, size_t bsize,
+		       unsigned char *nonce, size_t nsize, unsigned int diff,
+		       volatile sig_atomic_t *canceledp, long limit, long *iterp)
+{
+    SEARCH_SPECIALIZED(search_multibuffer, 8);
+}
+
+static int search_avx512(char *block, size_t bsize,
+			 unsigned char *nonce, size_t nsize, unsigned int diff,
+			 volatile sig_atomic_t *canceledp, long limit, long *iterp)
+{
+    SEARCH_SPECIALIZED(search_multibuffer, 16);
+}
+
+typedef int search_fn(char *block, size_t bsize,
+		      unsigned char *nonce, size_t nsize, unsigned int diff,
+		      volatile sig_atomic_t *canceledp, long limit, long *iterp);
+
+/*
+ * The backends (see miner.h), indexed by MINER_BACKEND_*.
+ */
+static struct {
+    const char *name;
+    search_fn *search;
+} miner_backends[NUM_MINER_BACKENDS] = {
+    [MINER_BACKEND_AUTO] =   { "auto",   NULL },
+    [MINER_BACKEND_GCRYPT] = { "gcrypt", search_gcrypt },
+    [MINER_BACKEND_SCALAR] = { "scalar", search_scalar },
+    [MINER_BACKEND_SHANI] =  { "shani",  search_shani },
+    [MINER_BACKEND_AVX2] =   { "avx2",   search_avx2 },
+    [MINER_BACKEND_AVX512] = { "avx512", search_avx512 }
+};
+
+/*
+ * The backend and number of threads to be used by solve(), determined once per
+ * process, on first use (solve() may be run by several threads at once in the
+ * master's thread mode).
+ */
+static int miner_backend = -1;
+static int miner_threads = 1;
+static pthread_once_t miner_init_once = PTHREAD_ONCE_INIT;
+
+int miner_backend_lookup(const char *name)
+{
+    for(int i = 0; i < NUM_MINER_BACKENDS; i++) {
+	if(!strcmp(miner_backends[i].name, name))
+	    return i;
+    }
+    return -1;
+}
+
+int miner_backend_supported(int backend)
+{
+    switch(backend) {
+    case MINER_BACKEND_SHANI:
+	return sha256_ni_supported();
+    case MINER_BACKEND_AVX2:
+	return sha256_mb_lanes() >= 8;
+    case MINER_BACKEND_AVX512:
+	return sha256_mb_lanes() >= 16;
+    default:
+	return 1;
+    }
+}
+
+/*
+ * Determine the backend to be used by this process: the one forced by the master,
+ * if any, otherwise automatic selection.  A forced backend that cannot be used here
+ * falls back to gcrypt.  Also determine the number of threads to search with.
+ */
+static void init_miner(void)
+{
+    char *name = getenv(MINER_THREADS_ENV);
+    int backend;
+    if(name != NULL && *name != '\0') {
+	int n = atoi(name);
+	miner_threads = n < 1 ? 1 : n > MINER_MAX_THREADS ? MINER_MAX_THREADS : n;
+	debug("[%d:Worker] Crypto miner using %d threads", getpid(), miner_threads);
+    }
+    name = getenv(MINER_BACKEND_ENV);
+    if(name == NULL || *name == '\0') {
+	miner_backend = MINER_BACKEND_AUTO;
+	return;
+    }
+    if((backend = miner_backend_lookup(name)) < 0) {
+	warn("[%d:Worker] Unknown crypto miner backend '%s', using gcrypt", getpid(), name);
+	backend = MINER_BACKEND_GCRYPT;
+    } else if(!miner_backend_supported(backend)) {
+	warn("[%d:Worker] Crypto miner backend '%s' not supported, using gcrypt", getpid(), name);
+	backend = MINER_BACKEND_GCRYPT;
+    } else {
+	debug("[%d:Worker] Crypto miner backend forced to %s", getpid(), name);
+    }
+    miner_backend = backend;
+}
+
+static double elapsed(struct timeval *start)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) / 1e6;
+}
+
+/*
+ * crypto_miner_hash_rate
+ * (See miner.h for specification.)
+ */
+double crypto_miner_hash_rate(int backend, size_t bsize, size_t nsize, long nonces)
+{
+    volatile sig_atomic_t canceled = 0;
+    struct timeval start;
+    long iter = 0;
+    if(backend <= MINER_BACKEND_AUTO || backend >= NUM_MINER_BACKENDS
+       || !miner_backend_supported(backend))
+	return 0;
+    char *block = malloc(bsize);
+    unsigned char *nonce = calloc(nsize, 1);
+    if(block == NULL || nonce == NULL) {
+	free(block);
+	free(nonce);
+	return 0;
+    }
+    for(size_t i = 0; i < bsize; i++)
+	block[i] = i;
+    // An all-zero digest will not turn up, but every digest is checked in full
+    // against the first word of the target, as it would be while mining.
+    gettimeofday(&start, NULL);
+    miner_backends[backend].search(block, bsize, nonce, nsize, 8 * SHA256_DIGEST_SIZE,
+				   &canceled, nonces, &iter);
+    double secs = elapsed(&start);
+    free(block);
+    free(nonce);
+    return secs > 0 ? iter / secs : 0;
+}
+
+/*
+ * Number of nonces that a thread of search_threaded() takes on at a time.  It is
+ * also the most that a thread hashes after the search has been canceled.
+ */
+#define THREAD_CHUNK 8192
+
+/*
+ * State shared by the threads of search_threaded().
+ */
+struct search_share {
+    search_fn *search;
+    char *block;
+    size_t bsize;
+    const unsigned char *start;         // First nonce of the range.
+    size_t nsize;
+    unsigned int diff;
+    volatile sig_atomic_t *canceledp;   // The solver's cancellation flag.
+    long limit;                         // Size of the range, or -1 for all.
+    _Atomic long next_chunk;            // Next chunk of the range to be searched.
+    _Atomic long iter;                  // Nonces tried, over all threads.
+    _Atomic int found;                  // Set by the thread that finds a solution.
+    volatile sig_atomic_t stop;         // Polled by the searches: stop now.
+    unsigned char *nonce;               // Receives the solution.
+};
+
+/*
+ * Add n to a nonce, as a little-endian counter.
+ * @return  0 if the result would not fit in the nonce, otherwise nonzero.
+ */
+static int advance_nonce(unsigned char *nonce, size_t nsize, unsigned long n)
+{
+    unsigned int carry = 0;
+    for(size_t i = 0; i < nsize; i++) {
+	unsigned int sum = nonce[i] + (n & 0xff) + carry;
+	nonce[i] = sum;
+	carry = sum >> 8;
+	n >>= 8;
+    }
+    return n == 0 && carry == 0;
+}
+
+static void *search_thread(void *arg)
+{
+    struct search_share *sh = arg;
+    unsigned char nonce[sh->nsize];
+    while(!sh->stop && !*sh->canceledp) {
+	long first = atomic_fetch_add(&sh->next_chunk, 1) * THREAD_CHUNK;
+	if(sh->limit >= 0 && first >= sh->limit)
+	    break;
+	memcpy(nonce, sh->start, sh->nsize);
+	if(!advance_nonce(nonce, sh->nsize, first))
+	    break;
+	long count = sh->limit >= 0 && sh->limit - first < THREAD_CHUNK ? sh->limit - first : THREAD_CHUNK;
+	long iter = 0;
+	int ret = sh->search(sh->block, sh->bsize, nonce, sh->nsize, sh->diff, &sh->stop, count, &iter);
+	atomic_fetch_add(&sh->iter, iter);
+	if(ret == 0) {
+	    // Of two threads with solutions, either may win; any solution will do.
+	    int expected = 0;
+	    if(atomic_compare_exchange_strong(&sh->found, &expected, 1))
+		memcpy(sh->nonce, nonce, sh->nsize);
+	    sh->stop = 1;
+	} else if(ret == 1) {
+	    // The end of the nonce space lies in this chunk.
+	    break;
+	}
+    }
+    return NULL;
+}
+
+/*
+ * Search a range of nonces with miner_threads threads, the calling thread among
+ * them.  The range is handed out in chunks of THREAD_CHUNK nonces, on demand.
+ * The first thread to find a solution stops the others through a flag that
+ * their searches poll in place of the solver's cancellation flag, which each
+ * thread checks between chunks instead.
+ *
+ * @return  As for solve().
+ */
+static int search_threaded(search_fn *search, char *block, size_t bsize,
+			   unsigned char *nonce, size_t nsize, unsigned int diff,
+			   volatile sig_atomic_t *canceledp, long limit, long *iterp)
+{
+    struct search_share sh = {
+	.search = search, .block = block, .bsize = bsize, .nsize = nsize, .diff = diff,
+	.canceledp = canceledp, .limit = limit, .nonce = nonce
+    };
+    unsigned char start[nsize];
+    memcpy(start, nonce, nsize);
+    sh.start = start;
+    pthread_t threads[MINER_MAX_THREADS];
+    int n;
+    for(n = 0; n < miner_threads - 1; n++) {
+	if(pthread_create(&threads[n], NULL, search_thread, &sh) != 0) {
+	    debug("[%d:Worker] Could only start %d search threads", getpid(), n);
+	    break;
+	}
+    }
+    search_thread(&sh);
+    for(int i = 0; i < n; i++)
+	pthread_join(threads[i], NULL);
+    *iterp += sh.iter;
+    if(sh.found)
+	return 0;
+    return *canceledp ? -1 : 1;
+}
+
+/*
+ * This function attempts to "solve" a block by iterating through a space of nonces.
+ * For each nonce, the concatenation of the block and the nonce is hashed, and the resulting
+ * digest is checked to see if it has the characteristics required of a solution.
+ *
+ * The hashing is done by one of the backends listed in miner.h.  Unless a backend
+ * has been forced, the one to use for a particular problem depends on the length of
+ * the block, on which instructions this processor has, and on how libgcrypt was
+ * built for it, so the first nonces are tried with each backend that the processor
+ * supports in turn, and the search continues with whichever of them ran fastest.
+ * All backends find the same solution; the scalar one serves as the reference.
+ *
+ * @param block  Pointer to the block to be solved.
+ * @param bsize  Size of the block in bytes.
+ * @param nonce  Pointer to an area where the nonce is to be stored.
+ * @param nsize  Size of the nonce in bytes.
+ * @param diff  The "difficulty" to be satisfied.  A digest satisfies the difficulty if
+ * it has this many leading zero bits.
+ * @param canceledp  Pointer to a flag which, if set, indicates that the current solution attempt
+ * should be abandoned.
+ * @param limit  The number of nonces to try, starting from the given one, or -1 to try
+ * them all.
+ * @return 0 if a solution is found, 1 if the space of possible nonces (or the specified
+ * number of them) is exhausted without finding any solution, -1 if solving was canceled.
+ */
+static int solve(char *block, size_t bsize,
+		 unsigned char *nonce, size_t nsize, unsigned int diff,
+		 volatile sig_atomic_t *canceledp, long limit)
+{
+    long iter = 0;
+    int ret;
+    struct timeval start;
+    gettimeofday(&start, NULL);
+    pthread_once(&miner_init_once, init_miner);
+    int backend = miner_backend;
+    if(backend == MINER_BACKEND_AUTO) {
+	double best = 0;
+	for(int b = MINER_BACKEND_AUTO + 1; b < NUM_MINER_BACKENDS; b++) {
+	    struct timeval t;
+	    if(!miner_backend_supported(b))
+		continue;
+	    if(limit >= 0 && iter >= limit)
+		break;
+	    gettimeofday(&t, NULL);
+	    ret = miner_backends[b].search(block, bsize, nonce, nsize, diff, canceledp,
+					   limit >= 0 && limit - iter < SOLVE_CALIBRATION_ITERS ?
+					   limit - iter : SOLVE_CALIBRATION_ITERS, &iter);
+	    if(ret != SEARCH_LIMIT)
+		goto out;
+	    double secs = elapsed(&t);
+	    debug("[%d:Worker] Backend %s: %.3f sec for %d nonces",
+		  getpid(), miner_backends[b].name, secs, SOLVE_CALIBRATION_ITERS);
+	    if(backend == MINER_BACKEND_AUTO || secs < best) {
+		backend = b;
+		best = secs;
+	    }
+	}
+	if(backend == MINER_BACKEND_AUTO) {
+	    // The limit was reached during calibration.
+	    ret = 1;
+	    goto out;
+	}
+	debug("[%d:Worker] Using backend %s", getpid(), miner_backends[backend].name);
+    }
+    if(limit >= 0 && iter >= limit)
+	ret = 1;
+    else if(miner_threads > 1)
+	ret = search_threaded(miner_backends[backend].search, block, bsize, nonce, nsize, diff,
+			      canceledp, limit >= 0 ? limit - iter : -1, &iter);
+    else
+	ret = miner_backends[backend].search(block, bsize, nonce, nsize, diff, canceledp,
+					     limit >= 0 ? limit - iter : -1, &iter);
+    if(ret == SEARCH_LIMIT)
+	ret = 1;
+ out:
+    if(ret == -1)
+	debug("[%d:Worker] Crypto miner solver canceled", getpid());
+    else if(ret == 1)
+	debug("[%d:Worker] No solution found after %lu iterations", getpid(), iter);
+    double secs = elapsed(&start);
+    debug("[%d:Worker] %lu hashes in %.3f sec (%.0f hashes/sec)",
+	  getpid(), iter, secs, secs > 0 ? iter / secs : 0.0);
+    stats_report_hashes(iter, secs);
+    return ret;
+}
+
 /*
  * Check whether a digest satisfies a specified "difficulty" requirement.
  *
@@ -304,20 +931,20 @@ static int solve(char *block, size_t bsize,
  * @param diff  Number of leading zero bits that must be in the digest.
  * @return nonzero if the digest has the specified number of leading zero bits,
  * 0 otherwise.
+ *
+ * The search engines set up the check once per problem with difficulty_init()
+ * instead (see difficulty.h).
  */
 static int check_result(unsigned char *digest, size_t dsize, unsigned int diff)
 {
-    for(int i = 0; i < dsize; i++) {
-	for(unsigned char mask = 0x80; mask != 0; mask >>= 1) {
-	    if(digest[i] & mask)
-		return 0;
-	    if(--diff == 0)
-		return 1;
-	}
+    struct difficulty target;
+    difficulty_init(&target, diff, dsize);
+    if(target.nwords == 0) {
+	debug("[%d:Worker] Difficulty (%d) too large for digest size (%lu)",
+	      getpid(), diff, dsize);
+	return 0;
     }
-    debug("[%d:Worker] Difficulty (%d) too large for digest size (%lu)",
-	  getpid(), diff, dsize);
-    return 0;
+    return difficulty_check_digest(&target, digest);
 }
 
 /*
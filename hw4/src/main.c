@@ -17,31 +17,74 @@
 
 #include "debug.h"
 #include "polya.h"
+#include "master.h"
+#include "pool.h"
+#include "miner.h"
+#include "placement.h"
+#include "workload.h"
 
 /*
  * "Polya" multiprocess problem solver: master process.
  *
  * Usage:
- *   polya [-w num_workers] [-p num_probs] [-t prob_type]
+ *   polya [-w num_workers] [-p num_probs] [-t prob_type] [-m mode] [-c transport]
+ *         [-H handoff] [-k pool_size] [-b backend] [-r chunk_bits] [-s start]
+ *         [-j miner_threads] [-P placement] [-M] [-S seed] [-T type_mix]
+ *         [-B block_sizes] [-N nonce_sizes] [-d difficulties] [-R trace_file]
  *
  * where:
- *   num_workers is the number of workers to use (min 1, max 32, default 1)
+ *   num_workers is the number of workers to use (min 1, default 1)
  *   num_probs is the total number of problems to be solved (default 0)
  *   prob_type is an integer specifying a problem type whose solver
  *     is to be enabled (min 0, max 31).  The -t flag may be repeated to enable
  *     multiple problem types.
+ *   mode selects the master's main loop: "epoll" (default) or "spin", or
+ *     "threads" to solve problems on a pool of threads in the master process,
+ *     one for each worker, in which case -c, -H and -s have no effect.
+ *   transport selects how problems and results are exchanged with workers:
+ *     "pipe" (default) or "shm" (shared-memory rings).
+ *   handoff selects how idle workers are set going: "signal" (default, with
+ *     SIGSTOP/SIGCONT) or "futex" (implies -c shm).
+ *   pool_size is the number of problems that may be open at once, with
+ *     workers spread across them (min 1, default 1).
+ *   backend forces the hashing backend used by crypto miner workers: "auto"
+ *     (default), "gcrypt", "scalar", "shani", "avx2" or "avx512".
+ *   chunk_bits selects chunked work distribution for crypto miner problems:
+ *     workers are handed ranges of 2^chunk_bits nonces on demand, rather than
+ *     one fixed share of the nonce space each (min 1, max 62, e.g. 24).
+ *   start selects how workers are started: "exec" (default, running
+ *     bin/polya_worker) or "fork" (forked from the master without exec).
+ *   miner_threads is the number of threads with which each worker searches
+ *     for the nonce of a crypto miner problem (min 1, max 64, default 1).
+ *   placement binds workers to CPUs and memory nodes: "none" (default),
+ *     "cores", "smt-spread" or "numa" (see placement.h).  The placement of
+ *     each worker is reported on stderr.
+ *   -M keeps counters, latencies and per-worker hash rates in a shared-memory
+ *     metrics segment while the master runs, for polya_stat to read.
+ *   seed seeds the generation of problems, so that a run can be repeated
+ *     with the same problems (default: the time of day).
+ *   type_mix weights the problem types, e.g. "1:3,2" (see workload.h); each
+ *     type in the mix is enabled as if by -t.
+ *   block_sizes, nonce_sizes and difficulties are distributions from which the
+ *     block size (min 1, max 4096, default "32"), nonce size (min 1, max 32,
+ *     default "8") and difficulty (min 1, max 64, default "20-25") of each
+ *     crypto miner problem are drawn, e.g. "32:3,64-128" (see workload.h).
+ *   trace_file receives a binary trace of the life of every problem (see
+ *     trace.h), which polya_trace converts to Chrome trace / Perfetto JSON.
  */
 int main(int argc, char *argv[])
 {
     int nworkers = 1;
     int nprobs = 0;
+    int pool_size = 1;
+    int chunk_bits = 0;
     unsigned int mask = 0;
     int type, option;
-    while((option = getopt(argc, argv, "w:p:t:")) != EOF) {
+    while((option = getopt(argc, argv, "w:p:t:m:c:H:k:b:r:s:j:P:MS:T:B:N:d:R:")) != EOF) {
 	switch(option) {
 	case 'w':
-	    if((nworkers = atoi(optarg++)) <= 0 || nworkers >= 32) {
-		fprintf(stderr, "-w (workers) requires argument in range [1..31]\n");
+	    if((nworkers = atoi(optarg++)) <= 0) {
+		fprintf(stderr, "-w (workers) requires a positive argument\n");
 		exit(EXIT_FAILURE);
 	    }
 	    break;
@@ -60,11 +103,132 @@ int main(int argc, char *argv[])
 	    }
 	    mask |= (1 << type);
 	    break;
+	case 'm':
+	    if(!strcmp(optarg, "epoll")) {
+		master_mode = MASTER_MODE_EPOLL;
+	    } else if(!strcmp(optarg, "spin")) {
+		master_mode = MASTER_MODE_SPIN;
+	    } else if(!strcmp(optarg, "threads")) {
+		master_mode = MASTER_MODE_THREADS;
+	    } else {
+		fprintf(stderr, "-m (mode) requires one of: epoll, spin, threads\n");
+		exit(EXIT_FAILURE);
+	    }
+	    break;
+	case 'c':
+	    if(!strcmp(optarg, "pipe")) {
+		master_transport = TRANSPORT_PIPE;
+	    } else if(!strcmp(optarg, "shm")) {
+		master_transport = TRANSPORT_SHM;
+	    } else {
+		fprintf(stderr, "-c (transport) requires one of: pipe, shm\n");
+		exit(EXIT_FAILURE);
+	    }
+	    break;
+	case 'k':
+	    if((pool_size = atoi(optarg)) <= 0) {
+		fprintf(stderr, "-k (pool size) requires a positive argument\n");
+		exit(EXIT_FAILURE);
+	    }
+	    break;
+	case 'H':
+	    if(!strcmp(optarg, "signal")) {
+		master_handoff = HANDOFF_SIGNAL;
+	    } else if(!strcmp(optarg, "futex")) {
+		master_handoff = HANDOFF_FUTEX;
+	    } else {
+		fprintf(stderr, "-H (handoff) requires one of: signal, futex\n");
+		exit(EXIT_FAILURE);
+	    }
+	    break;
+	case 'b':
+	    if((type = miner_backend_lookup(optarg)) < 0) {
+		fprintf(stderr, "-b (backend) requires one of: "
+			"auto, gcrypt, scalar, shani, avx2, avx512\n");
+		exit(EXIT_FAILURE);
+	    }
+	    if(!miner_backend_supported(type)) {
+		fprintf(stderr, "-b (backend): %s is not supported on this processor\n", optarg);
+		exit(EXIT_FAILURE);
+	    }
+	    // Workers inherit the environment.
+	    setenv(MINER_BACKEND_ENV, optarg, 1);
+	    break;
+	case 'r':
+	    if((chunk_bits = atoi(optarg)) < 1 || chunk_bits > 62) {
+		fprintf(stderr, "-r (chunk bits) requires argument in range [1..62]\n");
+		exit(EXIT_FAILURE);
+	    }
+	    break;
+	case 'j':
+	    if((type = atoi(optarg)) < 1 || type > MINER_MAX_THREADS) {
+		fprintf(stderr, "-j (miner threads) requires argument in range [1..%d]\n",
+			MINER_MAX_THREADS);
+		exit(EXIT_FAILURE);
+	    }
+	    // Workers inherit the environment.
+	    setenv(MINER_THREADS_ENV, optarg, 1);
+	    break;
+	case 'M':
+	    master_metrics = 1;
+	    break;
+	case 'R':
+	    master_trace = optarg;
+	    break;
+	case 'S':
+	    workload_set_seed(strtoul(optarg, NULL, 0));
+	    break;
+	case 'T':
+	    if(workload_set_type_mix(optarg, &mask) < 0) {
+		fprintf(stderr, "-T (type mix) requires a distribution of types in range [0..%d]\n",
+			NUM_PROBLEM_TYPES-1);
+		exit(EXIT_FAILURE);
+	    }
+	    break;
+	case 'B':
+	    if(workload_set_block_size(optarg) < 0) {
+		fprintf(stderr, "-B (block sizes) requires a distribution in range [1..%d]\n",
+			WORKLOAD_MAX_BSIZE);
+		exit(EXIT_FAILURE);
+	    }
+	    break;
+	case 'N':
+	    if(workload_set_nonce_size(optarg) < 0) {
+		fprintf(stderr, "-N (nonce sizes) requires a distribution in range [1..%d]\n",
+			WORKLOAD_MAX_NSIZE);
+		exit(EXIT_FAILURE);
+	    }
+	    break;
+	case 'd':
+	    if(workload_set_difficulty(optarg) < 0) {
+		fprintf(stderr, "-d (difficulties) requires a distribution in range [1..%d]\n",
+			WORKLOAD_MAX_DIFF);
+		exit(EXIT_FAILURE);
+	    }
+	    break;
+	case 'P':
+	    if((master_placement = placement_lookup(optarg)) < 0) {
+		fprintf(stderr, "-P (placement) requires one of: none, cores, smt-spread, numa\n");
+		exit(EXIT_FAILURE);
+	    }
+	    break;
+	case 's':
+	    if(!strcmp(optarg, "exec")) {
+		master_start = MASTER_START_EXEC;
+	    } else if(!strcmp(optarg, "fork")) {
+		master_start = MASTER_START_FORK;
+	    } else {
+		fprintf(stderr, "-s (start) requires one of: exec, fork\n");
+		exit(EXIT_FAILURE);
+	    }
+	    break;
 	default:
 	    fprintf(stderr, "Unknown option\n");
 	    exit(EXIT_FAILURE);
 	}
     }
     init_problems(nprobs, mask);
+    crypto_miner_set_chunk_bits(chunk_bits);
+    init_problem_pool(pool_size, chunk_bits != 0);
     return master(nworkers);
 }
@@ -1,533 +1,1020 @@
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <stdatomic.h>
 #include <unistd.h>
-#include <sys/types.h> //
-#include <sys/wait.h> //
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
 
 #include "debug.h"
 #include "polya.h"
+#include "master.h"
+#include "ring.h"
+#include "pool.h"
+#include "placement.h"
+#include "stats.h"
+#include "trace.h"
+
+int master_mode = MASTER_MODE_EPOLL;
+int master_transport = TRANSPORT_PIPE;
+int master_handoff = HANDOFF_SIGNAL;
+int master_start = MASTER_START_EXEC;
+int master_placement = PLACEMENT_NONE;
+int master_metrics = 0;
+char *master_trace = NULL;
 
-volatile sig_atomic_t done = 0;
-volatile sig_atomic_t fail = 0;
-sig_atomic_t worker_states[MAX_WORKERS];
-sig_atomic_t worker_pid[MAX_WORKERS];
-// started, idle, continued, running, stopped, exited, aborted
-struct problem *prob;
-struct result *res;
-void *still;
-
-int get_pid_index(int pid) {
-    int i;
-    for (i = 0; i < MAX_WORKERS; i++) {
-        if (pid == worker_pid[i]) {
-            return i;
-        }
+/*
+ * State kept by the master for each worker process.
+ */
+struct worker {
+    pid_t pid;                      // Process ID of the worker.
+    volatile sig_atomic_t state;    // WORKER_* state, as last observed.
+    int in;                         // Master's end of the result pipe.
+    int out;                        // Master's end of the problem pipe.
+    int bell;                       // Doorbell eventfd (futex handoff only).
+    struct channel *chan;           // Shared-memory rings, if used instead of pipes.
+    struct problem *prob;           // Problem being worked on, as given by the pool.
+    int var;                        // Variant of the problem being worked on.
+    int epoch;                      // Number of the current assignment of a problem.
+    struct timespec cancel_time;    // When the current assignment was canceled,
+                                    // or zero if it has not been.
+    struct result *res;             // Buffer in which a result is assembled.
+    size_t res_cap;                 // Capacity of the result buffer.
+    size_t res_len;                 // Number of bytes of the result received so far.
+    int queued;                     // Set while on the ready list.
+};
+
+// The worker table, sized by master() for the number of workers requested.
+static struct worker *worker_table;
+static int nworkers;
+
+// Open-addressed hash from worker PID to index + 1 in the worker table
+// (0 marks an empty slot), with at least twice as many slots as workers.
+static int *pid_slots;
+static unsigned int pid_mask;
+
+// Workers that have become idle, most recent last.  An entry for a worker
+// that has since exited is skipped when it is taken off.
+static int *idle_list;
+static volatile sig_atomic_t nidle = 0;
+
+// Workers that have stopped, or received data on their result pipe, since
+// the main loop last looked for results to finish.
+static int *ready_list;
+static volatile sig_atomic_t nready = 0;
+
+// Changes of state of worker processes collected by the SIGCHLD handler (spin
+// mode), for the main loop to act on.  The handler is the only producer and
+// the main loop the only consumer, so the ring needs no lock; the handler
+// makes at most CHLD_BATCH calls to waitpid() and leaves the rest to the main
+// loop, through chld_pending, so that its running time is bounded.
+#define CHLD_BATCH 16
+struct chld_event {
+    pid_t pid;
+    int status;
+};
+static struct chld_event *chld_ring;
+static unsigned int chld_mask_bits;
+static _Atomic unsigned int chld_head;   // Next slot to be written by the handler.
+static _Atomic unsigned int chld_tail;   // Next slot to be read by the main loop.
+static volatile sig_atomic_t chld_pending = 0;
+
+// Number of workers that are idle, exited or aborted.
+static volatile sig_atomic_t settled = 0;
+
+// Number of workers that have not yet exited or aborted.
+static volatile sig_atomic_t live = 0;
+// Set if any worker has aborted.
+static volatile sig_atomic_t fail = 0;
+
+// Signal mask in effect when master() was entered, and the same mask
+// with SIGCHLD added.
+static sigset_t orig_mask;
+static sigset_t chld_mask;
+
+// Event loop state (epoll mode only).  Events on a worker's result pipe
+// or doorbell carry the worker's index in the worker table.
+#define SIGNAL_TOKEN ((uint32_t)~0)
+static int epfd = -1;
+static int sigfd = -1;
+static struct epoll_event *events;
+
+// Source of epochs for the assignment of problems to workers.
+static int last_epoch = 0;
+
+// Cancel-to-idle latency: the time from the cancellation of a worker's
+// problem to the return of the worker to the idle state.
+static long cancel_count;
+static double cancel_total;
+static double cancel_max;
+
+// Startup and shutdown times.  Workers are all started at once, and the
+// times at which the first problem is sent and the last worker becomes
+// ready are recorded relative to spawn_start, in seconds (-1 if not yet).
+static struct timespec spawn_start;
+static volatile sig_atomic_t starting = 0;   // Workers not yet ready.
+static double first_problem_time = -1;
+static double all_ready_time = -1;
+// When the workers were asked to terminate.
+static struct timespec shutdown_start;
+
+// Environment given to workers: that of the master, with room at the end for
+// the variables that tell a worker where its channel, doorbell and entry in
+// the metrics segment are.
+extern char **environ;
+static char **worker_env;
+static int worker_env_len;
+
+static unsigned int pid_hash(pid_t pid) {
+    return ((unsigned int)pid * 2654435761u) & pid_mask;
+}
+
+/*
+ * Allocate the worker table and the lists that index it.
+ */
+static void alloc_workers(void) {
+    unsigned int slots = 1;
+    while(slots < 2 * (unsigned int)nworkers)
+        slots <<= 1;
+    pid_mask = slots - 1;
+    // Every worker can change state twice (stop, then exit) before the main
+    // loop gets to look.
+    unsigned int ring = CHLD_BATCH;
+    while(ring < 2 * (unsigned int)nworkers)
+        ring <<= 1;
+    chld_mask_bits = ring - 1;
+    if((worker_table = calloc(nworkers, sizeof(struct worker))) == NULL
+       || (pid_slots = calloc(slots, sizeof(int))) == NULL
+       || (chld_ring = calloc(ring, sizeof(struct chld_event))) == NULL
+       || (idle_list = calloc(nworkers, sizeof(int))) == NULL
+       || (ready_list = calloc(nworkers, sizeof(int))) == NULL) {
+        perror("Master worker table alloc error");
+        exit(EXIT_FAILURE);
     }
-    return -1;
 }
 
-// SIGCHLD HANDLER
-// can be notified when worker processes stop and continue
-void sigchld_handler(int sig) {
-    // child: idle, running, stopped, exited, aborted
-    debug("Received signal 17 (SIGCHLD)");
+static void add_worker_pid(struct worker *w) {
+    unsigned int h = pid_hash(w->pid);
+    while(pid_slots[h] != 0)
+        h = (h + 1) & pid_mask;
+    pid_slots[h] = (int)(w - worker_table) + 1;
+}
 
-    pid_t pid;
-    int status;
-    //pid_t pid = waitpid(-1, &status, WSTOPPED | WCONTINUED | WNOHANG); // pid, status, options
-    while ((pid = waitpid(-1, &status, WSTOPPED | WCONTINUED | WNOHANG)) > 0) {
-        if (pid == -1) {
-            perror("waitpid error");
-            exit(EXIT_FAILURE);
-        }
-        int index = get_pid_index(pid);
-        //debug("%s%d", "pid  ", pid);
-        //debug("%s%d", "worker state ", worker_states[index]);
-        // debug("%d", get_pid_index(pid));
-        if (WIFSTOPPED(status)) {
-            // debug("stopped");
-            if (worker_states[index] == WORKER_STARTED) {
-                // debug("made idle");
-                // started -> idle
-                worker_states[index] = WORKER_IDLE;
-                sf_change_state(pid, WORKER_STARTED, WORKER_IDLE); // -> IDLE
-            }
-            else if (worker_states[index] == WORKER_RUNNING) {
-                // debug("made stopped");
-                // running -> stopped
-                worker_states[index] = WORKER_STOPPED;
-                sf_change_state(pid, WORKER_RUNNING, WORKER_STOPPED); // -> STOPPED
-            } else {
-                // debug("early");
-                worker_states[index] = WORKER_STOPPED;
-                sf_change_state(pid, worker_states[index], WORKER_STOPPED); // -> STOPPED
-            }
-        }
-        else if (WIFCONTINUED(status)) { // -> RUNNING
-            // debug("cont to run");
-            // continued -> running
-            worker_states[index] = WORKER_RUNNING;
-            sf_change_state(pid, worker_states[index], WORKER_RUNNING);
-        }
-        else if (WIFEXITED(status)) { // -> EXITED
-            // debug("worker exited caught");
-            if (WEXITSTATUS(status) != 0) {
-                debug("abort");
-                worker_states[index] = WORKER_ABORTED;
-                sf_change_state(pid, worker_states[index], WORKER_ABORTED);
-                fail = 1;
-            } else {
-                worker_states[index] = WORKER_EXITED;
-                sf_change_state(pid, worker_states[index], WORKER_EXITED);
-                done = done + 1;
-            }
-        }
-        else if (WIFSIGNALED(status)) { // check aborted
-            debug("worker signaled exit caught");
-            if (WTERMSIG(status) != 0) {
-                debug("abort");
-                worker_states[index] = WORKER_ABORTED;
-                sf_change_state(pid, worker_states[index], WORKER_ABORTED);
-            } else {
-                worker_states[index] = WORKER_EXITED;
-                sf_change_state(pid, worker_states[index], WORKER_EXITED);
-            }
-        }
-        // debug("other");
+/*
+ * Find a worker by its PID.  Safe to call from the SIGCHLD handler, since the
+ * hash is only ever added to with SIGCHLD blocked.
+ */
+static struct worker *get_worker(pid_t pid) {
+    for(unsigned int h = pid_hash(pid); pid_slots[h] != 0; h = (h + 1) & pid_mask) {
+        struct worker *w = &worker_table[pid_slots[h] - 1];
+        if(w->pid == pid)
+            return w;
     }
-    // debug("EXIT HANDLER");
+    return NULL;
 }
 
 /*
- * master
- * (See polya.h for specification.)
+ * Put a worker on the ready list, unless it is already there.
  */
-int master(int workers) {
-    // TO BE IMPLEMENTED
+static void queue_ready(struct worker *w) {
+    if(w->queued)
+        return;
+    w->queued = 1;
+    ready_list[nready] = (int)(w - worker_table);
+    nready = nready + 1;
+}
 
-    // void sf_start(void)
-    // void sf_end(void)
-    // void sf_change_state(int pid, int oldstate, int newstate)
-    // void sf_send_problem(int pid, struct problem *prob)
-    // void sf_recv_result(int pid, struct result *result)
-    // void sf_cancel(int pid)
-    // get_problem_variant and post_result
+/*
+ * Return the time in seconds since t.
+ */
+static double elapsed_since(const struct timespec *t) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - t->tv_sec) + (now.tv_nsec - t->tv_nsec) / 1e9;
+}
 
-    sf_start();
+static int is_settled(int state) {
+    return state == WORKER_IDLE || state == WORKER_EXITED || state == WORKER_ABORTED;
+}
 
-    // INITIALIZATION
+/*
+ * Record a change of state of a worker and report it.
+ * This is only ever called from the main loop.
+ */
+static void set_state(struct worker *w, int state) {
+    int old = w->state;
+    w->state = state;
+    sf_change_state(w->pid, old, state);
+    stats_change_state((int)(w - worker_table), state);
+    trace_event(TRACE_STATE, (int)(w - worker_table), w->pid, w->prob ? w->prob->id : -1,
+                w->prob ? w->var : -1, state);
+    if(is_settled(state) != is_settled(old))
+        settled = settled + (is_settled(state) ? 1 : -1);
+    if(old == WORKER_STARTED) {
+        starting = starting - 1;
+        if(starting == 0)
+            all_ready_time = elapsed_since(&spawn_start);
+    }
+    if(state == WORKER_IDLE) {
+        idle_list[nidle] = (int)(w - worker_table);
+        nidle = nidle + 1;
+    } else if(state == WORKER_STOPPED) {
+        queue_ready(w);
+    }
+    if(state == WORKER_EXITED || state == WORKER_ABORTED) {
+        live = live - 1;
+        if(state == WORKER_ABORTED)
+            fail = 1;
+    }
+}
 
-    // during initialization, each time the master process creates a worker process,
-    // it creates two pipes for communicated with that worker process
-    // one pipe for sending problems from master to worker
-    // one pipe for sending results from worker to master
+/*
+ * Act on a change of state of a worker process, as reported by waitpid().
+ */
+static void child_status(pid_t pid, int status) {
+    struct worker *w = get_worker(pid);
+    if(w == NULL)
+        return;
+    if(WIFSTOPPED(status)) {
+        // A worker stops when it has finished initializing, and again
+        // each time it has written a result.
+        if(w->state == WORKER_STARTED)
+            set_state(w, WORKER_IDLE);
+        else
+            set_state(w, WORKER_STOPPED);
+    } else if(WIFCONTINUED(status)) {
+        if(w->state == WORKER_CONTINUED)
+            set_state(w, WORKER_RUNNING);
+    } else if(WIFEXITED(status)) {
+        debug("[%d:Master] Worker %d exited (status = %d)", getpid(), pid, WEXITSTATUS(status));
+        set_state(w, WEXITSTATUS(status) == EXIT_SUCCESS ? WORKER_EXITED : WORKER_ABORTED);
+    } else if(WIFSIGNALED(status)) {
+        debug("[%d:Master] Worker %d killed by signal %d", getpid(), pid, WTERMSIG(status));
+        set_state(w, WORKER_ABORTED);
+    }
+}
 
-    // pipe(2)
-        // before the worker process is forked
-    // fork(2)
-    // dup2(2)
-        // worker/child redirects its standard input and standard output to the pipes
-    // excel()
-        // worker program is executed using one of the exec(3)
+/*
+ * Collect all pending changes of state of worker processes.
+ */
+static void reap_workers(void) {
+    pid_t pid;
+    int status;
+    while((pid = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED)) > 0)
+        child_status(pid, status);
+}
 
-    // SIGPIPE HANDLER
-    // so that it is not inadvertently terminated by the premature exit of a worker process
-    if (signal(SIGPIPE, SIG_IGN) == SIG_ERR) { // Install the handler
-        perror("signal_error");
-        exit(EXIT_FAILURE);
+/*
+ * Act on the changes of state collected by the SIGCHLD handler, and then on
+ * any that it left for the main loop (spin mode).
+ * SIGCHLD must be blocked by the caller, so that changes are taken in order.
+ */
+static void drain_child_events(void) {
+    unsigned int tail = atomic_load_explicit(&chld_tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&chld_head, memory_order_acquire);
+    while(tail != head) {
+        struct chld_event *e = &chld_ring[tail & chld_mask_bits];
+        child_status(e->pid, e->status);
+        tail++;
     }
+    atomic_store_explicit(&chld_tail, tail, memory_order_release);
+    if(chld_pending) {
+        chld_pending = 0;
+        reap_workers();
+    }
+}
 
-    if (signal(SIGCHLD, sigchld_handler) == SIG_ERR) { // Install the handler
-        perror("signal_error");
+/*
+ * Pick up changes of state that a worker using futex handoff has made to
+ * its channel.  A worker may well have gone from WORKER_CONTINUED through
+ * WORKER_RUNNING to WORKER_STOPPED since it was last looked at, in which
+ * case only the stop is reported, as when it is observed through SIGCHLD.
+ */
+static void sync_handoff(struct worker *w) {
+    if(w->chan == NULL || w->state == WORKER_EXITED || w->state == WORKER_ABORTED)
+        return;
+    int hs = channel_state(w->chan);
+    if(hs == WORKER_IDLE && w->state == WORKER_STARTED)
+        set_state(w, WORKER_IDLE);
+    else if(hs == WORKER_RUNNING && w->state == WORKER_CONTINUED)
+        set_state(w, WORKER_RUNNING);
+    else if(hs == WORKER_STOPPED && (w->state == WORKER_CONTINUED || w->state == WORKER_RUNNING))
+        set_state(w, WORKER_STOPPED);
+}
+
+/*
+ * Pick up changes of state of all workers using futex handoff (spin mode).
+ */
+static void sync_handoffs(void) {
+    for(int i = 0; i < nworkers; i++)
+        sync_handoff(&worker_table[i]);
+}
+
+// SIGCHLD HANDLER (spin mode)
+// can be notified when worker processes stop and continue
+// only collects changes of state into the ring, for the main loop to act on.
+static void sigchld_handler(int sig) {
+    int olderrno = errno;
+    unsigned int head = atomic_load_explicit(&chld_head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&chld_tail, memory_order_acquire);
+    int n;
+    for(n = 0; n < CHLD_BATCH && head - tail <= chld_mask_bits; n++) {
+        int status;
+        pid_t pid = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED);
+        if(pid <= 0)
+            break;
+        chld_ring[head & chld_mask_bits].pid = pid;
+        chld_ring[head & chld_mask_bits].status = status;
+        head++;
+        atomic_store_explicit(&chld_head, head, memory_order_release);
+    }
+    // There may be more changes than were collected.
+    if(n == CHLD_BATCH || head - tail > chld_mask_bits)
+        chld_pending = 1;
+    errno = olderrno;
+}
+
+static void block_sigchld(sigset_t *prev) {
+    if(sigprocmask(SIG_BLOCK, &chld_mask, prev) < 0) {
+        perror("sigprocmask");
         exit(EXIT_FAILURE);
     }
+}
 
-    sigset_t mask_all;
-    sigset_t prev_all;
-    if (sigfillset(&mask_all) == -1) {
-        perror("sigfillset error");
+static void restore_mask(sigset_t *prev) {
+    if(sigprocmask(SIG_SETMASK, prev, NULL) < 0) {
+        perror("sigprocmask");
         exit(EXIT_FAILURE);
     }
-    sigset_t mask_child;
-    if (sigfillset(&mask_child) == -1) {
-        perror("sigfillset error");
+}
+
+/*
+ * Write a buffer in its entirety.
+ * A worker that has gone away (EPIPE) is not treated as an error here;
+ * its termination is reported as a change of state.
+ */
+static void write_fully(int fd, void *buf, size_t len) {
+    char *p = buf;
+    while(len > 0) {
+        ssize_t n = write(fd, p, len);
+        if(n < 0) {
+            if(errno == EINTR)
+                continue;
+            if(errno == EPIPE)
+                return;
+            perror("write error");
+            exit(EXIT_FAILURE);
+        }
+        p += n;
+        len -= n;
+    }
+}
+
+/*
+ * Make sure the result buffer of a worker can hold at least size bytes.
+ */
+static void reserve_result(struct worker *w, size_t size) {
+    if(w->res_cap >= size)
+        return;
+    if((w->res = realloc(w->res, size)) == NULL) {
+        perror("Master result realloc error");
         exit(EXIT_FAILURE);
     }
-    if (sigdelset(&mask_child, SIGCHLD) == -1) {
-        perror("sigdelset error");
+    w->res_cap = size;
+}
+
+/*
+ * Read whatever part of a result is available from a worker's result pipe,
+ * without blocking.
+ *
+ * @return 1 if a complete result has been assembled, 0 if more data is
+ * still expected, -1 if the pipe has been closed.
+ */
+static int read_result(struct worker *w) {
+    while(1) {
+        size_t want;
+        if(w->res_len < sizeof(struct result))
+            want = sizeof(struct result) - w->res_len;
+        else
+            want = w->res->size - w->res_len;
+        if(want == 0)
+            return 1;
+        ssize_t n = read(w->in, (char *)w->res + w->res_len, want);
+        if(n < 0) {
+            if(errno == EINTR)
+                continue;
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0;
+            perror("read error");
+            exit(EXIT_FAILURE);
+        }
+        if(n == 0)
+            return -1;
+        w->res_len += n;
+        if(w->res_len == sizeof(struct result)) {
+            if(w->res->size < sizeof(struct result)) {
+                debug("[%d:Master] Bad result size %ld from worker %d", getpid(), w->res->size, w->pid);
+                return -1;
+            }
+            reserve_result(w, w->res->size);
+        }
+    }
+}
+
+static int result_complete(struct worker *w) {
+    if(w->chan)
+        return ring_peek(w->chan->results) != NULL;
+    return w->res_len >= sizeof(struct result) && w->res_len == w->res->size;
+}
+
+/*
+ * Set up the environment given to workers.
+ */
+static void init_worker_env(void) {
+    int n = 0;
+    while(environ[n] != NULL)
+        n++;
+    if((worker_env = calloc(n + 5, sizeof(char *))) == NULL) {
+        perror("Master environment alloc error");
         exit(EXIT_FAILURE);
     }
+    memcpy(worker_env, environ, n * sizeof(char *));
+    worker_env_len = n;
+}
 
-    int pid;
+/*
+ * Run a worker forked from the master (fork mode), in place of exec'ing
+ * bin/polya_worker.  What belongs to the master and to the other workers is
+ * given up first, since none of it is closed by an exec here, and the worker's
+ * own descriptors are set up as posix_spawn() would for an exec'd worker.
+ * Doesn't return.
+ */
+static void run_forked_worker(struct worker *w, int send_problems[2], int send_results[2],
+                              char *chan_var, char *bell_var) {
+    signal(SIGCHLD, SIG_DFL);
+    stats_set_worker((int)(w - worker_table));
+    if(epfd >= 0)
+        close(epfd);
+    if(sigfd >= 0)
+        close(sigfd);
+    for(struct worker *o = worker_table; o < w; o++) {
+        if(o->in >= 0)
+            close(o->in);
+        if(o->out >= 0)
+            close(o->out);
+        if(o->bell >= 0)
+            close(o->bell);
+        if(o->chan)
+            channel_destroy(o->chan);
+    }
+    if(w->chan) {
+        putenv(chan_var);
+        if(w->bell >= 0)
+            putenv(bell_var);
+    } else {
+        if(dup2(send_problems[0], 0) == -1 || dup2(send_results[1], 1) == -1) {
+            perror("dup2 error");
+            exit(EXIT_FAILURE);
+        }
+        for(int i = 0; i < 2; i++) {
+            close(send_problems[i]);
+            close(send_results[i]);
+        }
+    }
+    sigprocmask(SIG_SETMASK, &orig_mask, NULL);
+    exit(worker());
+}
+
+/*
+ * Create a worker process, together with the pipes used to communicate with it.
+ * The worker is started with posix_spawn(), which doesn't copy the master's
+ * address space, or with fork() in fork mode, and is not waited for: it
+ * becomes idle in its own time.
+ *
+ * Every descriptor created here is close-on-exec, so that no worker inherits
+ * those of another (in particular, end-of-file on a result pipe means that its
+ * worker is gone); the ones meant for the worker are passed on with dup2().
+ */
+static void spawn_worker(struct worker *w) {
     // fd[0] = read, fd[1] = write
-    int send_problems[2];
-    int send_results[2];
-    int read_fd[workers];
-    int write_fd[workers];
-    FILE *in;
-    FILE *out;
-
-    // creates a number of worker processes (and associated pipes)
-    // as specified by the workers paremeter
-
-    int m;
-    for (m = 0; m < workers; m++) {
-        // debug("iterate through workers");
-
-        // pipe for sending problems from master to worker
-        if (pipe(send_problems) < 0) { // master to worker
-            perror("Can't create pipe");
+    int send_problems[2] = { -1, -1 };
+    int send_results[2] = { -1, -1 };
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    char chan_var[32], bell_var[32], stats_var[32], slot_var[32];
+    int nenv = worker_env_len;
+
+    if(posix_spawn_file_actions_init(&actions) != 0 || posix_spawnattr_init(&attr) != 0) {
+        perror("posix_spawn setup error");
+        exit(EXIT_FAILURE);
+    }
+    w->bell = -1;
+    if(master_transport == TRANSPORT_SHM) {
+        // The segment is mapped here, before the worker is started, and
+        // the worker maps it again from the descriptor.
+        if((w->chan = malloc(sizeof(struct channel))) == NULL
+           || channel_create(w->chan, CHANNEL_RING_SIZE) < 0) {
+            perror("Can't create channel");
             exit(EXIT_FAILURE);
         }
-        // pipe for sending results from worker to master
-        if (pipe(send_results) < 0) { // worker to master
+        placement_bind((int)(w - worker_table), w->chan->base, w->chan->len);
+        // Each worker has a doorbell of its own, so that the master knows
+        // which worker rang it.
+        if(master_handoff == HANDOFF_FUTEX
+           && (w->bell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+            perror("eventfd error");
+            exit(EXIT_FAILURE);
+        }
+        // A descriptor dup'ed onto itself stays open across exec.
+        posix_spawn_file_actions_adddup2(&actions, w->chan->fd, w->chan->fd);
+        snprintf(chan_var, sizeof(chan_var), "%s=%d", CHANNEL_FD_ENV, w->chan->fd);
+        worker_env[nenv++] = chan_var;
+        if(w->bell >= 0) {
+            posix_spawn_file_actions_adddup2(&actions, w->bell, w->bell);
+            snprintf(bell_var, sizeof(bell_var), "%s=%d", DOORBELL_FD_ENV, w->bell);
+            worker_env[nenv++] = bell_var;
+        }
+    } else {
+        if(pipe(send_problems) < 0 || pipe(send_results) < 0) {
             perror("Can't create pipe");
             exit(EXIT_FAILURE);
         }
+        for(int i = 0; i < 2; i++) {
+            fcntl(send_problems[i], F_SETFD, FD_CLOEXEC);
+            fcntl(send_results[i], F_SETFD, FD_CLOEXEC);
+        }
+        // stdin = problems, stdout = results
+        posix_spawn_file_actions_adddup2(&actions, send_problems[0], 0);
+        posix_spawn_file_actions_adddup2(&actions, send_results[1], 1);
+    }
+    if(stats_fd() >= 0) {
+        posix_spawn_file_actions_adddup2(&actions, stats_fd(), stats_fd());
+        snprintf(stats_var, sizeof(stats_var), "%s=%d", STATS_FD_ENV, stats_fd());
+        snprintf(slot_var, sizeof(slot_var), "%s=%d", STATS_SLOT_ENV, (int)(w - worker_table));
+        worker_env[nenv++] = stats_var;
+        worker_env[nenv++] = slot_var;
+    }
+    worker_env[nenv] = NULL;
+    posix_spawnattr_setsigmask(&attr, &orig_mask);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
 
-        read_fd[m] = send_results[0]; // master read results
-        write_fd[m] = send_problems[1]; // master write problems
+    pid_t pid;
+    placement_enter((int)(w - worker_table));
+    if(master_start == MASTER_START_FORK) {
+        // Anything left in a stdio buffer would be written again by the worker.
+        fflush(NULL);
+        if((pid = fork()) == 0)
+            run_forked_worker(w, send_problems, send_results, chan_var, bell_var);
+        if(pid < 0) {
+            perror("fork error");
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        char *argv[] = { "polya_worker", NULL };
+        int err = posix_spawn(&pid, "bin/polya_worker", &actions, &attr, argv, worker_env);
+        if(err != 0) {
+            errno = err;
+            perror("Worker spawn error");
+            exit(EXIT_FAILURE);
+        }
+    }
+    placement_leave();
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    placement_report((int)(w - worker_table), pid);
+
+    if(!w->chan) {
+        close(send_problems[0]);
+        close(send_results[1]);
+    }
+    w->pid = pid;
+    add_worker_pid(w);
+    stats_worker_started((int)(w - worker_table), pid);
+    w->in = send_results[0];
+    w->out = send_problems[1];
+    w->res_len = 0;
+    reserve_result(w, sizeof(struct result));
+    live = live + 1;
+    starting = starting + 1;
+    w->state = 0;
+    set_state(w, WORKER_STARTED);
+    debug("[%d:Master] Started worker %d (pid = %d, in = %d, out = %d)",
+          getpid(), (int)(w - worker_table), pid, w->in, w->out);
+}
 
+/*
+ * Send a problem to an idle worker and set it running.
+ * SIGCHLD must be blocked by the caller.
+ */
+static void send_problem(struct worker *w, struct problem *prob, int var) {
+    // Epochs are nonzero so that a zero cancellation word means "not canceled".
+    if(++last_epoch <= 0)
+        last_epoch = 1;
+    w->epoch = last_epoch;
+    w->cancel_time.tv_sec = w->cancel_time.tv_nsec = 0;
+    if(first_problem_time < 0)
+        first_problem_time = elapsed_since(&spawn_start);
+    stats_dispatch((int)(w - worker_table));
+    trace_event(TRACE_SEND, (int)(w - worker_table), w->pid, prob->id, var, 0);
+    if(w->chan) {
+        // Clear any cancellation of the worker's previous problem before the
+        // worker can see this one.
+        channel_cancel(w->chan, 0);
+        // The problem has to be in the ring before the worker is continued,
+        // since the worker won't wait for it.  The worker consumes each
+        // problem before it stops, so only a problem larger than the ring
+        // can fail to fit.
+        void *slot = ring_reserve(w->chan->problems, prob->size);
+        if(slot == NULL) {
+            fprintf(stderr, "Problem (size = %ld) too large for channel\n", prob->size);
+            exit(EXIT_FAILURE);
+        }
+        memcpy(slot, prob, prob->size);
+        ring_commit(w->chan->problems, prob->size);
+    }
+    if(master_handoff == HANDOFF_FUTEX) {
+        debug("[%d:Master] Waking worker %d", getpid(), w->pid);
+        channel_set_state(w->chan, WORKER_CONTINUED);
+        channel_wake(w->chan);
+    } else {
+        debug("[%d:Master] Sending SIGCONT to worker %d", getpid(), w->pid);
+        kill(w->pid, SIGCONT);
+    }
+    trace_event(TRACE_CONTINUE, (int)(w - worker_table), w->pid, prob->id, var, 0);
+    set_state(w, WORKER_CONTINUED);
+    sf_send_problem(w->pid, prob);
+    if(!w->chan) {
+        // The problem can be written once the worker is continued, so that
+        // a problem larger than the pipe buffer does not block the master.
+        write_fully(w->out, prob, prob->size);
+    }
+    w->prob = prob;
+    w->var = var;
+    w->res_len = 0;
+}
 
-        if ((pid = fork()) == 0) { // CHILD
-            debug("Started worker %d%s%d%s%d%s", m, " (in = ", send_problems[0], ", out = ", send_results[1], ")");
+/*
+ * Notify the workers still busy with a problem that has just been solved.
+ * Workers on other problems in the pool are left alone.  A worker with a
+ * channel has the epoch of its assignment stored in its cancellation word,
+ * which its solver polls; otherwise the worker is sent SIGHUP.
+ * SIGCHLD must be blocked by the caller.
+ */
+static void cancel_workers(struct problem *solved) {
+    for(int i = 0; i < nworkers; i++) {
+        struct worker *w = &worker_table[i];
+        if(w->prob != solved)
+            continue;
+        if(w->state == WORKER_CONTINUED || w->state == WORKER_RUNNING) {
+            sf_cancel(w->pid);
+            trace_event(TRACE_CANCEL, i, w->pid, solved->id, w->var, 0);
+            clock_gettime(CLOCK_MONOTONIC, &w->cancel_time);
+            if(w->chan)
+                channel_cancel(w->chan, w->epoch);
+            else
+                kill(w->pid, SIGHUP);
+        }
+    }
+}
 
-            // stdin = problems
-            if (dup2(send_problems[0], 0) == -1) { // read problems written by master
-                // oldfd, newfd
-                perror("dup2 errorr");
-                exit(EXIT_FAILURE);
-            }
-            // stout = reults
-            if (dup2(send_results[1], 1) == -1) { // write results read by master
-                perror("dup2 errorr");
-                exit(EXIT_FAILURE);
-            }
+/*
+ * Account for the cancel-to-idle latency of a worker that has just become idle,
+ * if its assignment was canceled.
+ */
+static void record_cancel_latency(struct worker *w) {
+    if(w->cancel_time.tv_sec == 0 && w->cancel_time.tv_nsec == 0)
+        return;
+    double secs = elapsed_since(&w->cancel_time);
+    cancel_count++;
+    cancel_total += secs;
+    if(secs > cancel_max)
+        cancel_max = secs;
+    w->cancel_time.tv_sec = w->cancel_time.tv_nsec = 0;
+}
 
-            if (close(send_problems[1]) == -1) { // close write problem
-                perror("close error");
-                exit(EXIT_FAILURE);
-            }
-            if (close(send_results[0]) == -1) { // close read results
-                perror("close error");
-                exit(EXIT_FAILURE);
-            }
+/*
+ * Deal with the result read from a stopped worker, and make the worker idle.
+ * SIGCHLD must be blocked by the caller.
+ */
+static void finish_result(struct worker *w) {
+    // A result in a ring is used in place and released once posted.
+    struct result *res = w->chan ? ring_peek(w->chan->results) : w->res;
+    int canceled = w->cancel_time.tv_sec != 0 || w->cancel_time.tv_nsec != 0;
+    int index = (int)(w - worker_table);
+    sf_recv_result(w->pid, res);
+    stats_result(index, res->failed, canceled);
+    // The acknowledgement comes first, so that it falls within the problem.
+    if(canceled)
+        trace_event(TRACE_CANCEL_ACK, index, w->pid, w->prob->id, w->var, 0);
+    trace_event(TRACE_RESULT, index, w->pid, w->prob->id, w->var, res->failed);
+    set_state(w, WORKER_IDLE);
+    record_cancel_latency(w);
+    if(master_handoff == HANDOFF_FUTEX)
+        channel_set_state(w->chan, WORKER_IDLE);
+    w->res_len = 0;
+    struct problem *prob = w->prob;
+    w->prob = NULL;
+    // The pool frees a solved problem once its last variant comes back,
+    // so prob is only compared against, not used, after this.
+    int id = prob->id;
+    int posted = post_pool_result(res, prob, w->var);
+    trace_event(TRACE_POST, index, w->pid, id, w->var, posted);
+    if(posted == 0)
+        cancel_workers(prob);
+    if(w->chan)
+        ring_release(w->chan->results);
+}
 
-            debug("Starting worker %d%s%d%s", m, " (", pid, ")");
+/*
+ * Assign problems to idle workers.
+ * SIGCHLD must be blocked by the caller.
+ *
+ * @return 0 if there are no more problems to be solved, otherwise 1.
+ */
+static int assign_problems(void) {
+    while(nidle > 0) {
+        struct worker *w = &worker_table[idle_list[nidle - 1]];
+        if(w->state != WORKER_IDLE) {
+            nidle = nidle - 1;
+            continue;
+        }
+        int var;
+        struct problem *prob = get_pool_variant(nworkers, &var);
+        if(prob == NULL)
+            break;
+        nidle = nidle - 1;
+        send_problem(w, prob, var);
+    }
+    return !pool_exhausted();
+}
 
-            if (execl("bin/polya_worker", "polya_worker", NULL) == -1) {
-                perror("Worker execl erorr");
-                exit(EXIT_FAILURE);
-            }
-        } else if (pid < 0) {
-            perror("fork error");
-            exit(EXIT_FAILURE);
-        } else { // PARENT
-            debug("Parent %d", m);
+static int all_idle(void) {
+    return settled == nworkers;
+}
 
-            if (close(send_problems[0]) == -1) { // close read problem
-                perror("close error");
-                exit(EXIT_FAILURE);
-            }
-            if (close(send_results[1]) == -1) { // close write reults
-                perror("close error");
-                exit(EXIT_FAILURE);
-            }
+/*
+ * Finish the results of the workers on the ready list that have stopped with
+ * a complete result.  A worker whose result is still arriving on its pipe is
+ * put back on the list when more of it is read.
+ * SIGCHLD must be blocked by the caller.
+ */
+static void finish_ready(void) {
+    while(nready > 0) {
+        nready = nready - 1;
+        struct worker *w = &worker_table[ready_list[nready]];
+        w->queued = 0;
+        if(w->state != WORKER_STOPPED)
+            continue;
+        // In spin mode the pipe blocks, and a stopped worker has written
+        // all of its result, so this reads the rest of it.
+        if(!w->chan && !result_complete(w))
+            read_result(w);
+        if(result_complete(w))
+            finish_result(w);
+    }
+}
 
-            if (sigprocmask(SIG_BLOCK, &mask_all, &prev_all) < 0) { // block
-                perror("sigprocmask");
-                exit(EXIT_FAILURE);
-            }
-            worker_states[m] = WORKER_STARTED;
-            sf_change_state(pid, 0, WORKER_STARTED);
-            worker_pid[m] = pid;
-            if (sigprocmask(SIG_SETMASK, &prev_all, NULL) < 0) { // unblock
-                perror("sigprocmask");
-                exit(EXIT_FAILURE);
-            }
+/*
+ * Ask all remaining workers to terminate.  The workers are signaled one after
+ * another without waiting for any of them; their exits are collected by the
+ * main loop as they happen.
+ * SIGCHLD must be blocked by the caller.
+ */
+static void terminate_workers(void) {
+    debug("[%d:Master] All live workers are idle -- terminating", getpid());
+    clock_gettime(CLOCK_MONOTONIC, &shutdown_start);
+    for(int i = 0; i < nworkers; i++) {
+        struct worker *w = &worker_table[i];
+        if(w->state == WORKER_EXITED || w->state == WORKER_ABORTED)
+            continue;
+        kill(w->pid, SIGTERM);
+        kill(w->pid, SIGCONT);
+    }
+}
 
-            // wait for master to get sigchld
-            sigsuspend(&mask_child);
+/*
+ * Wait for and handle one batch of events (epoll mode).
+ */
+static void handle_events(void) {
+    int n = epoll_wait(epfd, events, nworkers + 1, -1);
+    if(n < 0) {
+        if(errno == EINTR)
+            return;
+        perror("epoll_wait error");
+        exit(EXIT_FAILURE);
+    }
+    for(int i = 0; i < n; i++) {
+        if(events[i].data.u32 == SIGNAL_TOKEN) {
+            struct signalfd_siginfo si;
+            while(read(sigfd, &si, sizeof(si)) == sizeof(si))
+                ;
+            reap_workers();
+            continue;
+        }
+        struct worker *w = &worker_table[events[i].data.u32];
+        if(w->bell >= 0) {
+            uint64_t count;
+            if(read(w->bell, &count, sizeof(count)) == sizeof(count))
+                sync_handoff(w);
+            continue;
+        }
+        if(read_result(w) < 0) {
+            // Worker has closed its end of the pipe; its exit will be
+            // reported through the signalfd.
+            epoll_ctl(epfd, EPOLL_CTL_DEL, w->in, NULL);
+            close(w->in);
+            w->in = -1;
+        } else if(w->state == WORKER_STOPPED) {
+            queue_ready(w);
         }
     }
+    finish_ready();
+}
 
-    //MAIN LOOP
-
-    // PARENT
-    debug("MASTER");
-
-    // enters a main loop that repeatedly assign problems to idle workers
-    // until all of the worker processes have become idle and
-    // NULL is returned from get_problem_variant
+/*
+ * Event-driven main loop.  SIGCHLD stays blocked throughout and changes of
+ * worker state are collected from a signalfd, so the master sleeps in
+ * epoll_wait() whenever it has nothing to do.
+ */
+static void master_epoll(void) {
+    sigset_t sigchld;
+    sigemptyset(&sigchld);
+    sigaddset(&sigchld, SIGCHLD);
+    if((sigfd = signalfd(-1, &sigchld, SFD_NONBLOCK | SFD_CLOEXEC)) < 0
+       || (epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        perror("event setup error");
+        exit(EXIT_FAILURE);
+    }
+    if((events = calloc(nworkers + 1, sizeof(struct epoll_event))) == NULL) {
+        perror("Master event alloc error");
+        exit(EXIT_FAILURE);
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = SIGNAL_TOKEN };
+    if(epoll_ctl(epfd, EPOLL_CTL_ADD, sigfd, &ev) < 0) {
+        perror("epoll_ctl error");
+        exit(EXIT_FAILURE);
+    }
 
-    while(1) {
-        if ((get_problem_variant(workers, 0)) != NULL) { // problems left
-            // assign problem to idle workers
-            for (int w = 0; w < workers; w++) {
-                if ((get_problem_variant(workers, w)) == NULL) { // can happen in this for loop
-                    // debug("no more");
-                } else {
-                    //debug("%d", w);
-                    if (worker_states[w] == WORKER_IDLE) { // IDLE
-
-                        if (sigprocmask(SIG_BLOCK, &mask_all, &prev_all) < 0) { // block
-                            perror("sigprocmask");
-                            exit(EXIT_FAILURE);
-                        }
-
-                        // CREATE PROBLEM
-
-                        prob = get_problem_variant(workers, w);
-                        // master process send a problem to the worker process
-                        if ((out = fdopen(write_fd[w], "w")) == NULL) { // output
-                            perror("Parent can't create output stream");
-                            exit(EXIT_FAILURE);
-                        }
-                        // first writes a the fixed-size problem header to the pipe,
-                        // and then continues by writing the problem data
-
-                        // 1. read the header
-                        fwrite(prob, sizeof(struct problem), 1, out);
-                        //ferror
-                        if (ferror(out)) {
-                            perror("ferror");
-                            exit(EXIT_FAILURE);
-                        }
-                        debug("Write problem");
-                        // examine the size field of this structure and read an additional size
-                        // 2. malloc storage for the full problem (header + data)
-                        // 3. copy the already-read header into the beginning of the malloc'ed area
-                        // prob = realloc(prob, prob->size); // realloc for new size (header + data)
-                        if (prob == NULL) {
-                            perror("Master problem realloc error");
-                            exit(EXIT_FAILURE);
-                        }
-                        // 4. read the remaining data into the rest of the malloc'ed area
-                        fwrite(prob->data, (prob->size - sizeof(struct problem)), 1, out);
-                        debug("Write data");
-                        // debug("M Got problem: size = %ld%s%d%s%d", prob->size, ", type = ", prob->type, ", variants = ", prob->nvars);
-                        //ferror
-                        if (ferror(out)) {
-                            perror("ferror");
-                            exit(EXIT_FAILURE);
-                        }
-
-                        debug("Flush");
-                        if (fflush(out) == EOF) {
-                            perror("fflush error");
-                            exit(EXIT_FAILURE);
-                        }
-
-                        if (sigprocmask(SIG_SETMASK, &prev_all, NULL) < 0) { // unblock
-                            perror("sigprocmask");
-                            exit(EXIT_FAILURE);
-                        }
-
-                        sf_send_problem(worker_pid[w], prob);
-
-                        // reads problem
-                        // idle -> continued
-                        debug("Sending SIGCONT to worker");
-
-                        if (sigprocmask(SIG_BLOCK, &mask_all, &prev_all) < 0) { // block
-                            perror("sigprocmask");
-                            exit(EXIT_FAILURE);
-                        }
-
-                        kill(worker_pid[w], SIGCONT);
-                        worker_states[get_pid_index(worker_pid[w])] = WORKER_CONTINUED;
-                        sf_change_state(worker_pid[w], WORKER_IDLE, WORKER_CONTINUED);
-
-                        if (sigprocmask(SIG_SETMASK, &prev_all, NULL) < 0) { // unblock
-                            perror("sigprocmask");
-                            exit(EXIT_FAILURE);
-                        }
-                    }
-
-                    // posts results received from workers
-                    // worker state = stopped
-                    if (worker_states[w] == WORKER_STOPPED) { // STOPPED
-
-                        if (sigprocmask(SIG_BLOCK, &mask_all, &prev_all) < 0) { // block
-                            perror("sigprocmask");
-                            exit(EXIT_FAILURE);
-                        }
-
-                        // READ RESULT
-                        if ((in = fdopen(read_fd[w], "r")) == NULL) { // input
-                            perror("Parent can't create input stream");
-                            exit(EXIT_FAILURE);
-                        }
-
-                        // READ THE RESULT FROM CHILD
-                        res = (struct result*) malloc(sizeof(struct result));
-                        if (res == NULL) {
-                            perror("Parent read result header malloc error");
-                            exit(EXIT_FAILURE);
-                        }
-                        //debug("Read result");
-                        //debug("Read data (nbytes = %ld%s", sizeof(struct result), ")");
-                        // 1. read the header
-                        fread(res, sizeof(struct result), 1, in); // ptr, size (each size bytes long), nmemb (items of data), stream
-                        //ferror
-                        if (ferror(in)) {
-                            perror("ferror");
-                            exit(EXIT_FAILURE);
-                        }
-                        // examine the size field of this structure and read an additional size
-                        // 2. malloc storage for the full problem (header + data)
-                        // 3. copy the already-read header into the beginning of the malloc'ed area
-                        res = realloc(res, res->size); // realloc for new size (header + data)
-                        if (res == NULL) {
-                            perror("Parent read result realloc error");
-                            exit(EXIT_FAILURE);
-                        }
-                        //debug("Got result: size = %ld%s%d", res->size, ", failed = ", res->failed);
-                        // 4. read the remaining data into the rest of the malloc'ed area
-                        fread(res->data, (res->size - sizeof(struct result)), 1, in);
-                        //ferror
-                        if (ferror(in)) {
-                            perror("ferror");
-                            exit(EXIT_FAILURE);
-                        }
-
-                        if (fflush(in) == EOF) {
-                            perror("fflush error");
-                            exit(EXIT_FAILURE);
-                        }
-
-                        if (sigprocmask(SIG_SETMASK, &prev_all, NULL) < 0) { // unblock
-                            perror("sigprocmask");
-                            exit(EXIT_FAILURE);
-                        }
-
-                        // master process has received a result over the pipe
-                        sf_recv_result(worker_pid[w], res);
-
-                        // CHECK RESULT
-                        if(post_result(res, prob) == 0) { // if correct result
-                            // cancel other workers that are doing this problem
-                            // master process notify worker process to cancel solution procedure
-                            for (int c = 0; c < workers; c++) {
-                                if (worker_pid[c] != worker_pid[w]) { // skip this worker
-
-                                    // and was solving actively solving a problem
-
-                                    // cancel
-                                    sf_cancel(worker_pid[c]);
-
-                                    /*
-                                    if (sigprocmask(SIG_BLOCK, &mask_all, &prev_all) < 0) { // block
-                                        perror("sigprocmask");
-                                        exit(EXIT_FAILURE);
-                                    }
-                                    */
-                                    kill(worker_pid[c], SIGHUP);
-                                    // sigsuspend(&mask_child);
-                                    /*
-                                    if (sigprocmask(SIG_SETMASK, &prev_all, NULL) < 0) { // unblock
-                                        perror("sigprocmask");
-                                        exit(EXIT_FAILURE);
-                                    }
-                                    */
-                                }
-                            }
-                        }
-
-                        free(res);
-
-                        // change this worker state
-                        // stopped -> idle
-                        // kill(worker_pid[w], SIGSTOP);
-                        if (sigprocmask(SIG_BLOCK, &mask_all, &prev_all) < 0) { // block
-                            perror("sigprocmask");
-                            exit(EXIT_FAILURE);
-                        }
-                        worker_states[get_pid_index(worker_pid[w])] = WORKER_IDLE;
-                        sf_change_state(worker_pid[w], WORKER_STOPPED, WORKER_IDLE);
-                        if (sigprocmask(SIG_SETMASK, &prev_all, NULL) < 0) { // unblock
-                            perror("sigprocmask");
-                            exit(EXIT_FAILURE);
-                        }
-                    }
-                }
-            }
-        } else { // no more problems
-
-            // until finally all of the worker processes have become idle and
-            // a NULL return from the get_problem_variant function
-            // indicates that there are no further problems to be solved
-            // when all workers are IDLE
-            // started -> idle -> running -> exited
-            for (int w = 0; w < workers; w++) {
-                // debug("%d%d", w, worker_states[w]);
-
-                if (worker_states[w] == WORKER_STOPPED) {
-                    // set to idle
-                    if (sigprocmask(SIG_BLOCK, &mask_all, &prev_all) < 0) { // block
-                        perror("sigprocmask");
-                        exit(EXIT_FAILURE);
-                    }
-                    worker_states[get_pid_index(worker_pid[w])] = WORKER_IDLE;
-                    sf_change_state(worker_pid[w], WORKER_STOPPED, WORKER_IDLE);
-                    if (sigprocmask(SIG_SETMASK, &prev_all, NULL) < 0) { // unblock
-                        perror("sigprocmask");
-                        exit(EXIT_FAILURE);
-                    }
-                }
-
-                // worker must be idle in order to terminate
-                if (worker_states[w] == WORKER_IDLE || worker_states[w] == WORKER_RUNNING) {
-                    // once this has occurred, a SIGTERM signal is sent to each of the worker processes
-                    // which catch this signal and exit normally
-                    // debug("no problems worker idle");
-
-                    if (sigprocmask(SIG_BLOCK, &mask_all, &prev_all) < 0) { // block
-                        perror("sigprocmask");
-                        exit(EXIT_FAILURE);
-                    }
-
-                    kill(worker_pid[w], SIGTERM); // master sends SIGTERM
-                    kill(worker_pid[w], SIGCONT); // sends SIGCONT
-                    if (worker_states[w] != WORKER_EXITED) {
-                        sigsuspend(&mask_child);
-                    }
-
-                    if (sigprocmask(SIG_SETMASK, &prev_all, NULL) < 0) { // unblock
-                        perror("sigprocmask");
-                        exit(EXIT_FAILURE);
-                    }
-                }
+    // Start all of the workers, and let them become ready while the main
+    // loop hands problems to the ones that already are.
+    clock_gettime(CLOCK_MONOTONIC, &spawn_start);
+    for(int i = 0; i < nworkers; i++) {
+        struct worker *w = &worker_table[i];
+        spawn_worker(w);
+        // At most one of these is in use.
+        int fd = w->in >= 0 ? w->in : w->bell;
+        if(fd >= 0) {
+            if(w->in >= 0)
+                fcntl(w->in, F_SETFL, fcntl(w->in, F_GETFL) | O_NONBLOCK);
+            ev.events = EPOLLIN;
+            ev.data.u32 = i;
+            if(epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+                perror("epoll_ctl error");
+                exit(EXIT_FAILURE);
             }
+        }
+    }
 
-            // When all of the worker processes have terminated, the master process itself
-            // also terminates
+    int more = 1, terminating = 0;
+    while(live > 0) {
+        if(more)
+            more = assign_problems();
+        if(!more && !terminating && all_idle()) {
+            terminate_workers();
+            terminating = 1;
+        }
+        handle_events();
+    }
+    close(epfd);
+    close(sigfd);
+    free(events);
+}
 
-            // exit status of the master process is EXIT_SUCCESS if all workers are EXIT_SUCCESS
-            // otherwise exit status is EXIT_FAILURE
+/*
+ * Busy-polling main loop.  Worker state is updated asynchronously by the
+ * SIGCHLD handler, which also puts workers that become idle or stop with a
+ * result on lists that the loop repeatedly takes them off.
+ */
+static void master_spin(void) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigchld_handler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if(sigaction(SIGCHLD, &sa, NULL) < 0) {
+        perror("sigaction error");
+        exit(EXIT_FAILURE);
+    }
 
-            if (fail == 1) {
-                debug("EXIT_FAILURE");
-                // free(res);
-                sf_end();
-                exit(EXIT_FAILURE);
-            }
+    sigset_t prev;
+    block_sigchld(&prev);
+    clock_gettime(CLOCK_MONOTONIC, &spawn_start);
+    for(int i = 0; i < nworkers; i++)
+        spawn_worker(&worker_table[i]);
+    restore_mask(&prev);
+
+    int more = 1;
+    while(more || !all_idle()) {
+        block_sigchld(&prev);
+        drain_child_events();
+        if(master_handoff == HANDOFF_FUTEX)
+            sync_handoffs();
+        finish_ready();
+        if(more)
+            more = assign_problems();
+        restore_mask(&prev);
+    }
 
-            if (done == workers && fail != 1) { // assumes all workers terminate
-                debug("EXIT_SUCCESS");
-                // close file descriptors
-                for (int i = 0; i < workers; i++) {
-                    if (read_fd[i] != 0 && read_fd[i] != 1 && read_fd[i] != 2 && write_fd[i] != 0 && write_fd[i] != 1 && write_fd[i] != 2) {
-                        close(read_fd[i]);
-                        close(write_fd[i]);
-                    }
-                }
-                // free(res);
-                sf_end();
-                exit(EXIT_SUCCESS);
-            }
+    block_sigchld(&prev);
+    terminate_workers();
+    drain_child_events();
+    while(live > 0) {
+        sigsuspend(&orig_mask);
+        drain_child_events();
+    }
+    restore_mask(&prev);
+}
 
-        }
-    } // main while loop
+/*
+ * master
+ * (See polya.h for specification.)
+ */
+int master(int workers) {
+    if(master_mode == MASTER_MODE_THREADS)
+        return master_threads(workers);
+    sf_start();
+    nworkers = workers > 0 ? workers : 1;
+    placement_init(master_placement, nworkers);
+    if(master_metrics && stats_create(nworkers) < 0)
+        perror("Can't create metrics segment");
+    if(master_trace && trace_open(master_trace, nworkers) < 0)
+        perror("Can't create trace file");
+    alloc_workers();
+    init_worker_env();
 
-    return EXIT_FAILURE;
+    // SIGPIPE HANDLER
+    // so that it is not inadvertently terminated by the premature exit of a worker process
+    if(signal(SIGPIPE, SIG_IGN) == SIG_ERR) {
+        perror("signal_error");
+        exit(EXIT_FAILURE);
+    }
+    if(master_handoff == HANDOFF_FUTEX)
+        master_transport = TRANSPORT_SHM;
+    sigemptyset(&chld_mask);
+    sigaddset(&chld_mask, SIGCHLD);
+    block_sigchld(&orig_mask);
+    sigdelset(&orig_mask, SIGCHLD);
+
+    if(master_mode == MASTER_MODE_SPIN) {
+        restore_mask(&orig_mask);
+        master_spin();
+    } else {
+        master_epoll();
+        restore_mask(&orig_mask);
+    }
+    info("[%d:Master] Shutdown: all workers exited %.1f ms after being asked to terminate",
+         getpid(), shutdown_start.tv_sec ? elapsed_since(&shutdown_start) * 1e3 : 0.0);
+
+    for(int i = 0; i < nworkers; i++) {
+        struct worker *w = &worker_table[i];
+        if(w->in >= 0)
+            close(w->in);
+        if(w->out >= 0)
+            close(w->out);
+        if(w->chan) {
+            channel_destroy(w->chan);
+            free(w->chan);
+        }
+        if(w->bell >= 0)
+            close(w->bell);
+        free(w->res);
+    }
+    free(worker_table);
+    free(pid_slots);
+    free(idle_list);
+    free(ready_list);
+    free(chld_ring);
+    free(worker_env);
+    stats_destroy();
+    trace_close();
+    info("[%d:Master] Startup: all %d workers ready after %.1f ms",
+         getpid(), nworkers, all_ready_time * 1e3);
+    if(first_problem_time >= 0)
+        info("[%d:Master] Startup: first problem sent after %.1f ms", getpid(), first_problem_time * 1e3);
+    if(cancel_count > 0)
+        info("[%d:Master] %ld cancellations, cancel-to-idle latency: mean %.1f us, max %.1f us",
+             getpid(), cancel_count, cancel_total / cancel_count * 1e6, cancel_max * 1e6);
+    sf_end();
+    if(fail) {
+        debug("[%d:Master] EXIT_FAILURE", getpid());
+        return EXIT_FAILURE;
+    }
+    debug("[%d:Master] EXIT_SUCCESS", getpid());
+    return EXIT_SUCCESS;
 }
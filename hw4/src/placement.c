@@ -0,0 +1,277 @@
+/*
+ * Placement of workers on CPUs and memory nodes (see placement.h).
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "debug.h"
+#include "placement.h"
+
+#define SYSFS_CPU "/sys/devices/system/cpu"
+#define SYSFS_NODE "/sys/devices/system/node"
+
+// Largest node number catered for in node masks.
+#define MAX_NODES 1024
+#define MASK_WORDS (MAX_NODES / (8 * sizeof(unsigned long)))
+
+/*
+ * A CPU available to the master, and where it lies in the topology.
+ */
+struct cpu_info {
+    int cpu;
+    int package;
+    int core;       // Core ID, unique within the package.
+    int rank;       // Position among the hardware threads of its core.
+    int node;
+};
+
+static const char *policy_names[] = {
+    [PLACEMENT_NONE] = "none",
+    [PLACEMENT_CORES] = "cores",
+    [PLACEMENT_SMT_SPREAD] = "smt-spread",
+    [PLACEMENT_NUMA] = "numa"
+};
+
+static int policy = PLACEMENT_NONE;
+static cpu_set_t saved_cpus;
+static cpu_set_t *worker_cpus;
+static int *worker_node;
+
+int placement_lookup(const char *name) {
+    for(int i = 0; i < sizeof(policy_names) / sizeof(policy_names[0]); i++) {
+        if(!strcmp(policy_names[i], name))
+            return i;
+    }
+    return -1;
+}
+
+static int read_int(const char *path) {
+    FILE *f = fopen(path, "r");
+    int val = -1;
+    if(f == NULL)
+        return -1;
+    if(fscanf(f, "%d", &val) != 1)
+        val = -1;
+    fclose(f);
+    return val;
+}
+
+/*
+ * Read a list of CPUs in the sysfs format ("0-3,8,10-11").
+ * @return 0 if successful, -1 otherwise.
+ */
+static int read_cpulist(const char *path, cpu_set_t *set) {
+    FILE *f = fopen(path, "r");
+    int lo, hi;
+    char sep;
+    CPU_ZERO(set);
+    if(f == NULL)
+        return -1;
+    while(fscanf(f, "%d", &lo) == 1) {
+        hi = lo;
+        if(fscanf(f, "%c", &sep) == 1 && sep == '-') {
+            if(fscanf(f, "%d", &hi) != 1)
+                break;
+            if(fscanf(f, "%c", &sep) != 1)
+                sep = '\n';
+        }
+        for(int c = lo; c <= hi && c < CPU_SETSIZE; c++)
+            CPU_SET(c, set);
+        if(sep != ',')
+            break;
+    }
+    fclose(f);
+    return 0;
+}
+
+/*
+ * Find the node of each CPU.  CPUs in no node (no NUMA support) are in node 0.
+ */
+static void read_nodes(struct cpu_info *cpus, int ncpus) {
+    DIR *dir = opendir(SYSFS_NODE);
+    struct dirent *de;
+    for(int i = 0; i < ncpus; i++)
+        cpus[i].node = 0;
+    if(dir == NULL)
+        return;
+    while((de = readdir(dir)) != NULL) {
+        int node;
+        char path[300];
+        cpu_set_t set;
+        if(sscanf(de->d_name, "node%d", &node) != 1 || node >= MAX_NODES)
+            continue;
+        snprintf(path, sizeof(path), SYSFS_NODE "/%s/cpulist", de->d_name);
+        if(read_cpulist(path, &set) < 0)
+            continue;
+        for(int i = 0; i < ncpus; i++) {
+            if(CPU_ISSET(cpus[i].cpu, &set))
+                cpus[i].node = node;
+        }
+    }
+    closedir(dir);
+}
+
+static int compare_spread(const void *a, const void *b) {
+    const struct cpu_info *x = a, *y = b;
+    if(x->rank != y->rank)
+        return x->rank - y->rank;
+    return x->cpu - y->cpu;
+}
+
+static void format_cpus(cpu_set_t *set, char *buf, size_t len) {
+    size_t n = 0;
+    buf[0] = '\0';
+    for(int c = 0; c < CPU_SETSIZE && n < len; c++) {
+        if(!CPU_ISSET(c, set))
+            continue;
+        int hi = c;
+        while(hi + 1 < CPU_SETSIZE && CPU_ISSET(hi + 1, set))
+            hi++;
+        if(hi == c)
+            n += snprintf(buf + n, len - n, "%s%d", n ? "," : "", c);
+        else
+            n += snprintf(buf + n, len - n, "%s%d-%d", n ? "," : "", c, hi);
+        c = hi;
+    }
+}
+
+/*
+ * placement_init
+ * (See placement.h for specification.)
+ */
+void placement_init(int pol, int nworkers) {
+    policy = pol;
+    if(policy == PLACEMENT_NONE)
+        return;
+    if(sched_getaffinity(0, sizeof(saved_cpus), &saved_cpus) < 0) {
+        perror("sched_getaffinity error");
+        exit(EXIT_FAILURE);
+    }
+    int ncpus = CPU_COUNT(&saved_cpus);
+    struct cpu_info *cpus = calloc(ncpus, sizeof(struct cpu_info));
+    worker_cpus = calloc(nworkers, sizeof(cpu_set_t));
+    worker_node = calloc(nworkers, sizeof(int));
+    if(cpus == NULL || worker_cpus == NULL || worker_node == NULL) {
+        perror("Master placement alloc error");
+        exit(EXIT_FAILURE);
+    }
+    for(int c = 0, i = 0; c < CPU_SETSIZE && i < ncpus; c++) {
+        if(!CPU_ISSET(c, &saved_cpus))
+            continue;
+        char path[128];
+        struct cpu_info *ci = &cpus[i++];
+        ci->cpu = c;
+        snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/topology/physical_package_id", c);
+        ci->package = read_int(path);
+        snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/topology/core_id", c);
+        // Without topology information, every CPU is taken to be a core.
+        if((ci->core = read_int(path)) < 0)
+            ci->core = c;
+        ci->rank = 0;
+        for(int j = 0; j < i - 1; j++) {
+            if(cpus[j].package == ci->package && cpus[j].core == ci->core)
+                ci->rank++;
+        }
+    }
+    read_nodes(cpus, ncpus);
+
+    if(policy == PLACEMENT_SMT_SPREAD)
+        qsort(cpus, ncpus, sizeof(struct cpu_info), compare_spread);
+    if(policy == PLACEMENT_NUMA) {
+        // Deal the workers out over the nodes that have CPUs available.
+        int nodes[ncpus], nnodes = 0;
+        for(int i = 0; i < ncpus; i++) {
+            int j = 0;
+            while(j < nnodes && nodes[j] != cpus[i].node)
+                j++;
+            if(j == nnodes)
+                nodes[nnodes++] = cpus[i].node;
+        }
+        for(int w = 0; w < nworkers; w++) {
+            worker_node[w] = nodes[w % nnodes];
+            CPU_ZERO(&worker_cpus[w]);
+            for(int i = 0; i < ncpus; i++) {
+                if(cpus[i].node == worker_node[w])
+                    CPU_SET(cpus[i].cpu, &worker_cpus[w]);
+            }
+        }
+    } else {
+        for(int w = 0; w < nworkers; w++) {
+            struct cpu_info *ci = &cpus[w % ncpus];
+            worker_node[w] = ci->node;
+            CPU_ZERO(&worker_cpus[w]);
+            CPU_SET(ci->cpu, &worker_cpus[w]);
+        }
+    }
+    if(nworkers > ncpus)
+        warn("[%d:Master] %d workers placed on %d CPUs", getpid(), nworkers, ncpus);
+    free(cpus);
+}
+
+static void node_mask(int node, unsigned long mask[MASK_WORDS]) {
+    memset(mask, 0, MASK_WORDS * sizeof(unsigned long));
+    mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+}
+
+/*
+ * placement_enter
+ * (See placement.h for specification.)
+ */
+void placement_enter(int worker) {
+    unsigned long mask[MASK_WORDS];
+    if(policy == PLACEMENT_NONE)
+        return;
+    if(sched_setaffinity(0, sizeof(cpu_set_t), &worker_cpus[worker]) < 0)
+        warn("[%d:Master] Can't set CPU affinity: %s", getpid(), strerror(errno));
+    // A preferred node, rather than a binding, leaves the worker able to
+    // allocate elsewhere should its node run out of memory.
+    node_mask(worker_node[worker], mask);
+    if(syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, MAX_NODES) < 0)
+        warn("[%d:Master] Can't set memory policy: %s", getpid(), strerror(errno));
+}
+
+/*
+ * placement_leave
+ * (See placement.h for specification.)
+ */
+void placement_leave(void) {
+    if(policy == PLACEMENT_NONE)
+        return;
+    sched_setaffinity(0, sizeof(saved_cpus), &saved_cpus);
+    syscall(SYS_set_mempolicy, MPOL_DEFAULT, NULL, 0);
+}
+
+/*
+ * placement_bind
+ * (See placement.h for specification.)
+ */
+void placement_bind(int worker, void *addr, size_t len) {
+    unsigned long mask[MASK_WORDS];
+    if(policy == PLACEMENT_NONE)
+        return;
+    node_mask(worker_node[worker], mask);
+    if(syscall(SYS_mbind, addr, len, MPOL_PREFERRED, mask, MAX_NODES, 0) < 0)
+        warn("[%d:Master] Can't set memory policy of channel: %s", getpid(), strerror(errno));
+}
+
+/*
+ * placement_report
+ * (See placement.h for specification.)
+ */
+void placement_report(int worker, pid_t pid) {
+    char cpus[256];
+    if(policy == PLACEMENT_NONE)
+        return;
+    format_cpus(&worker_cpus[worker], cpus, sizeof(cpus));
+    fprintf(stderr, "placement (%s): worker %d (pid = %d) on cpus %s, node %d\n",
+            policy_names[policy], worker, pid, cpus, worker_node[worker]);
+}
@@ -14,13 +14,18 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <limits.h>
 #include <unistd.h>
 #include <sys/time.h>
 
 #include "debug.h"
 #include "polya.h"
+#include "pool.h"
+#include "workload.h"
+#include "trace.h"
 
 static void new_problem(int type, int nvars);
+static struct problem *construct_problem(int type, int nvars);
 
 /* The problem currently being solved (in its several variant forms). */
 static struct problem *current_problem;
@@ -34,6 +39,127 @@ static int problems_remaining;
 /* Number of enabled problem types. */
 static int num_problem_types;
 
+/* Seed for the generation of problems, if one was given. */
+static int seed_given;
+static unsigned int seed;
+
+/*
+ * A distribution of integers (see workload.h).
+ */
+struct distribution {
+    int nitems;
+    int total;              // Sum of the weights.
+    struct {
+	int lo, hi;
+	int weight;
+    } items[WORKLOAD_MAX_ITEMS];
+};
+
+/* Distributions of the parameters of crypto miner problems. */
+static struct distribution block_sizes = { 1, 1, { { 32, 32, 1 } } };
+static struct distribution nonce_sizes = { 1, 1, { { 8, 8, 1 } } };
+static struct distribution difficulties = { 1, 1, { { 20, 25, 1 } } };
+
+/* Mix of problem types, if one was given. */
+static struct distribution type_mix;
+
+/*
+ * Parse a distribution whose values must lie in [min..max].
+ * @return 0 if successful, otherwise -1, leaving the distribution unchanged.
+ */
+static int parse_distribution(const char *spec, struct distribution *dist, int min, int max) {
+    struct distribution d = { 0 };
+    const char *s = spec;
+    while(1) {
+	char *end;
+	if(d.nitems == WORKLOAD_MAX_ITEMS)
+	    return -1;
+	long lo = strtol(s, &end, 10), hi = lo, weight = 1;
+	if(end == s)
+	    return -1;
+	if(*end == '-') {
+	    s = end + 1;
+	    hi = strtol(s, &end, 10);
+	    if(end == s)
+		return -1;
+	}
+	if(*end == ':') {
+	    s = end + 1;
+	    weight = strtol(s, &end, 10);
+	    if(end == s)
+		return -1;
+	}
+	if(lo < min || hi > max || lo > hi || weight < 1 || weight > 1000000)
+	    return -1;
+	d.items[d.nitems].lo = lo;
+	d.items[d.nitems].hi = hi;
+	d.items[d.nitems++].weight = weight;
+	d.total += weight;
+	if(*end == '\0')
+	    break;
+	if(*end != ',')
+	    return -1;
+	s = end + 1;
+    }
+    *dist = d;
+    return 0;
+}
+
+/*
+ * Draw a value from a distribution.  A distribution of a single value draws
+ * no random numbers, so that fixing a parameter leaves the sequence of the
+ * others as it was.
+ */
+static int draw(struct distribution *d) {
+    int i = 0;
+    if(d->nitems > 1) {
+	int w = random() % d->total;
+	while(w >= d->items[i].weight)
+	    w -= d->items[i++].weight;
+    }
+    if(d->items[i].lo == d->items[i].hi)
+	return d->items[i].lo;
+    return d->items[i].lo + random() % (d->items[i].hi - d->items[i].lo + 1);
+}
+
+void workload_set_seed(unsigned int s) {
+    seed = s;
+    seed_given = 1;
+}
+
+int workload_set_block_size(const char *spec) {
+    return parse_distribution(spec, &block_sizes, 1, WORKLOAD_MAX_BSIZE);
+}
+
+int workload_set_nonce_size(const char *spec) {
+    return parse_distribution(spec, &nonce_sizes, 1, WORKLOAD_MAX_NSIZE);
+}
+
+int workload_set_difficulty(const char *spec) {
+    return parse_distribution(spec, &difficulties, 1, WORKLOAD_MAX_DIFF);
+}
+
+int workload_set_type_mix(const char *spec, unsigned int *maskp) {
+    if(parse_distribution(spec, &type_mix, 0, NUM_PROBLEM_TYPES - 1) < 0)
+	return -1;
+    for(int i = 0; i < type_mix.nitems; i++) {
+	for(int t = type_mix.items[i].lo; t <= type_mix.items[i].hi; t++)
+	    *maskp |= 1 << t;
+    }
+    return 0;
+}
+
+/*
+ * Select an enabled problem type at random: from the mix, if one was given,
+ * otherwise with each type equally likely.  The caller draws again if the
+ * type selected has no solver.
+ */
+static int select_type(void) {
+    if(type_mix.nitems)
+	return draw(&type_mix);
+    return random() % NUM_PROBLEM_TYPES;
+}
+
 /* Bit mask controlling which types of problems are generated. */
 static unsigned int prob_type_mask;
 
@@ -52,7 +178,7 @@ void (*solver_initializers[NUM_PROBLEM_TYPES])(void) = {
 void init_problems(int nprobs, unsigned int mask) {
     struct timeval tv;
     gettimeofday(&tv, NULL);
-    srandom(tv.tv_usec);
+    srandom(seed_given ? seed : tv.tv_usec);
     problems_remaining = nprobs;
     prob_type_mask = mask;
     for(int i = 0; i < NUM_PROBLEM_TYPES; i++) {
@@ -61,6 +187,16 @@ void init_problems(int nprobs, unsigned int mask) {
 	    (*solver_initializers[i])();
 	}
     }
+    // A mix of types none of which has a solver generates no problems.
+    if(type_mix.nitems) {
+	int usable = 0;
+	for(int i = 0; i < type_mix.nitems; i++) {
+	    for(int t = type_mix.items[i].lo; t <= type_mix.items[i].hi; t++)
+		usable |= solvers[t].construct != NULL;
+	}
+	if(!usable)
+	    num_problem_types = 0;
+    }
 }
 
 /*
@@ -72,7 +208,7 @@ struct problem *get_problem_variant(int nvars, int var) {
     if(prob == NULL && num_problem_types > 0) {
 	// Select an enabled problem type at random.
 	while(problems_remaining && current_problem == NULL) {
-	    int type = random() % NUM_PROBLEM_TYPES;
+	    int type = select_type();
 	    if(solvers[type].construct)
 		new_problem(type, nvars);
 	}
@@ -91,6 +227,7 @@ struct problem *get_problem_variant(int nvars, int var) {
 	return NULL;
     }
     (*solvers[prob->type].vary)(prob, var);
+    trace_event(TRACE_VARY, -1, -1, prob->id, var, 0);
     return prob;
 }
 
@@ -107,28 +244,46 @@ static void new_problem(int type, int nvars) {
 	free(current_problem);
 	current_problem = NULL;
     }
+    current_problem = construct_problem(type, nvars);
+    if(current_problem)
+	trace_event(TRACE_CONSTRUCT, -1, -1, current_problem->id, -1, type);
+}
+
+/*
+ * Construct a problem, of a specified type and with a specified
+ * number of possible variant forms, if any more problems are to be generated.
+ *
+ * @param type  The type of problem to be created.
+ * @param nvars  The number of possible variant forms of the problem.
+ * @return  The problem, or NULL if no more problems are to be generated
+ * or the problem could not be constructed.
+ */
+static struct problem *construct_problem(int type, int nvars) {
     static int id = 0;
     if(problems_remaining-- > 0) {
 	++id;
 	debug("[%d:Master] Generating problem, number remaining: %d", getpid(), problems_remaining);
 	switch(type) {
 	case TRIVIAL_PROBLEM_TYPE:
-	    current_problem = solvers[type].construct(id, nvars);
-	    return;
+	    return solvers[type].construct(id, nvars);
 	case CRYPTO_MINER_PROBLEM_TYPE:
 	    {
-		char block[32];
+		int bsize = draw(&block_sizes);
+		int nsize = draw(&nonce_sizes);
+		char block[bsize];
 		// Generate random block data.
 		for(int i = 0; i < sizeof(block); i++)
 		    block[i] = random() & 0xff;
-		current_problem = solvers[type].construct(id, nvars, block, sizeof(block), 8, 25);
+		int diff = draw(&difficulties);
+		debug("[%d:Master] Problem %d: bsize = %d, nsize = %d, diff = %d",
+		      getpid(), id, bsize, nsize, diff);
+		return solvers[type].construct(id, nvars, block, sizeof(block), nsize, diff);
 	    }
-	    return;
 	default:
-	    return;
+	    return NULL;
 	}
     }
-    current_problem = NULL;
+    return NULL;
 }
 
 /*
@@ -153,3 +308,171 @@ int post_result(struct result *result, struct problem *prob) {
 	return 1;
     }
 }
+
+/*
+ * Problem pool.
+ * The pool keeps up to pool_size problems open at once.  Each open problem
+ * has its own record of which of its variants are out with workers, and of
+ * whether it has been solved.  A solved problem is freed once the last of
+ * its variants has been returned.  In chunked mode, variants are instead
+ * handed out in sequence and never reused, so only their number is recorded.
+ */
+struct pool_entry {
+    struct problem *prob;   // The problem, or NULL if this slot is free.
+    int solved;             // Nonzero once a correct result has been posted.
+    int inflight;           // Number of variants out with workers.
+    int nvars;              // Number of variant forms.
+    char *busy;             // busy[v] is nonzero while variant v is out.
+    int next_var;           // In chunked mode, the next variant to hand out.
+};
+
+static struct pool_entry *pool;
+static int pool_size;
+static int pool_chunked;
+
+/*
+ * init_problem_pool
+ * (See pool.h for specification.)
+ */
+void init_problem_pool(int size, int chunked) {
+    pool_size = size > 0 ? size : 1;
+    pool_chunked = chunked;
+    pool = calloc(pool_size, sizeof(struct pool_entry));
+    if(pool == NULL) {
+	perror("init_problem_pool");
+	exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * Open a new problem in a free pool slot.
+ * @return  The slot, or NULL if no more problems are to be generated.
+ */
+static struct pool_entry *open_problem(struct pool_entry *e, int nvars) {
+    struct problem *prob = NULL;
+    // Select an enabled problem type at random.
+    while(num_problem_types > 0 && problems_remaining && prob == NULL) {
+	int type = select_type();
+	if(solvers[type].construct)
+	    prob = construct_problem(type, nvars);
+    }
+    if(prob == NULL)
+	return NULL;
+    trace_event(TRACE_CONSTRUCT, -1, -1, prob->id, -1, prob->type);
+    if(!pool_chunked && (e->busy = calloc(nvars, 1)) == NULL) {
+	free(prob);
+	return NULL;
+    }
+    debug("[%d:Master] Opened problem %d in pool", getpid(), prob->id);
+    e->prob = prob;
+    e->solved = 0;
+    e->inflight = 0;
+    e->nvars = pool_chunked ? INT_MAX : nvars;
+    e->next_var = 0;
+    return e;
+}
+
+static void close_problem(struct pool_entry *e) {
+    debug("[%d:Master] Closing problem %d", getpid(), e->prob->id);
+    free(e->prob);
+    free(e->busy);
+    e->prob = NULL;
+    e->busy = NULL;
+}
+
+static struct pool_entry *find_entry(struct problem *prob) {
+    for(int i = 0; i < pool_size; i++) {
+	if(pool[i].prob == prob)
+	    return &pool[i];
+    }
+    return NULL;
+}
+
+/*
+ * get_pool_variant
+ * (See pool.h for specification.)
+ */
+struct problem *get_pool_variant(int nvars, int *varp) {
+    // Top the pool up to its full complement of open problems.
+    for(int i = 0; i < pool_size; i++) {
+	if(pool[i].prob == NULL && open_problem(&pool[i], nvars) == NULL)
+	    break;
+    }
+    // Choose the unsolved problem with the fewest workers on it, so that
+    // the workers are spread over all of the open problems.
+    struct pool_entry *best = NULL;
+    for(int i = 0; i < pool_size; i++) {
+	struct pool_entry *e = &pool[i];
+	if(e->prob == NULL || e->solved || e->inflight >= e->nvars)
+	    continue;
+	if(best == NULL || e->inflight < best->inflight
+	   || (e->inflight == best->inflight && e->prob->id < best->prob->id))
+	    best = e;
+    }
+    if(best == NULL)
+	return NULL;
+    int var = 0;
+    if(pool_chunked) {
+	var = best->next_var;
+    } else {
+	while(best->busy[var])
+	    var++;
+    }
+    if(solvers[best->prob->type].vary == NULL) {
+	debug("[%d:Master] No varier for problem type %d", getpid(), best->prob->type);
+	return NULL;
+    }
+    (*solvers[best->prob->type].vary)(best->prob, var);
+    trace_event(TRACE_VARY, -1, -1, best->prob->id, var, 0);
+    if(pool_chunked) {
+	// Wrap around rather than overflow, should it ever come to that.
+	best->next_var = var == INT_MAX ? 0 : var + 1;
+    } else {
+	best->busy[var] = 1;
+    }
+    best->inflight++;
+    *varp = var;
+    return best->prob;
+}
+
+/*
+ * post_pool_result
+ * (See pool.h for specification.)
+ */
+int post_pool_result(struct result *result, struct problem *prob, int var) {
+    struct pool_entry *e = find_entry(prob);
+    if(e == NULL) {
+	debug("[%d:Master] Result posted for problem %p not in pool", getpid(), prob);
+	return -1;
+    }
+    int ret;
+    if(e->solved) {
+	debug("[%d:Master] Problem %d already solved", getpid(), prob->id);
+	ret = -1;
+    } else if((ret = post_result(result, prob)) == 0) {
+	e->solved = 1;
+    }
+    if(pool_chunked) {
+	e->inflight--;
+    } else if(var >= 0 && var < e->nvars && e->busy[var]) {
+	e->busy[var] = 0;
+	e->inflight--;
+    }
+    if(e->solved && e->inflight == 0)
+	close_problem(e);
+    return ret;
+}
+
+/*
+ * pool_exhausted
+ * (See pool.h for specification.)
+ */
+int pool_exhausted(void) {
+    if(num_problem_types > 0 && problems_remaining > 0)
+	return 0;
+    for(int i = 0; i < pool_size; i++) {
+	if(pool[i].prob != NULL && !pool[i].solved)
+	    return 0;
+    }
+    return 1;
+}
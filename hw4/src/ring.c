@@ -0,0 +1,150 @@
+/*
+ * Shared-memory message rings (see ring.h).
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "debug.h"
+#include "ring.h"
+
+#define ROUND(n) (((n) + RING_ALIGN - 1) & ~(size_t)(RING_ALIGN - 1))
+
+static size_t ring_bytes(size_t cap) {
+    return sizeof(struct ring) + cap;
+}
+
+static void channel_layout(struct channel *ch, size_t cap) {
+    ch->ctl = ch->base;
+    ch->problems = (struct ring *)((char *)ch->base + sizeof(struct channel_ctl));
+    ch->results = (struct ring *)((char *)ch->problems + ring_bytes(cap));
+}
+
+int channel_create(struct channel *ch, size_t cap) {
+    size_t c = RING_ALIGN;
+    while(c < cap)
+        c <<= 1;
+    ch->len = sizeof(struct channel_ctl) + 2 * ring_bytes(c);
+    if((ch->fd = memfd_create("polya_channel", MFD_CLOEXEC)) < 0)
+        return -1;
+    if(ftruncate(ch->fd, ch->len) < 0) {
+        close(ch->fd);
+        return -1;
+    }
+    ch->base = mmap(NULL, ch->len, PROT_READ | PROT_WRITE, MAP_SHARED, ch->fd, 0);
+    if(ch->base == MAP_FAILED) {
+        close(ch->fd);
+        return -1;
+    }
+    // The segment is zero-filled by ftruncate(), so both rings start out empty.
+    channel_layout(ch, c);
+    ch->problems->cap = c;
+    ch->results->cap = c;
+    return 0;
+}
+
+int channel_attach(struct channel *ch, int fd) {
+    struct stat st;
+    if(fstat(fd, &st) < 0)
+        return -1;
+    ch->fd = fd;
+    ch->len = st.st_size;
+    ch->base = mmap(NULL, ch->len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(ch->base == MAP_FAILED)
+        return -1;
+    size_t cap = ((struct ring *)((char *)ch->base + sizeof(struct channel_ctl)))->cap;
+    channel_layout(ch, cap);
+    if(sizeof(struct channel_ctl) + 2 * ring_bytes(cap) != ch->len) {
+        debug("[%d] Channel segment has unexpected size %ld", getpid(), ch->len);
+        munmap(ch->base, ch->len);
+        return -1;
+    }
+    return 0;
+}
+
+void channel_destroy(struct channel *ch) {
+    if(ch->base != NULL && ch->base != MAP_FAILED)
+        munmap(ch->base, ch->len);
+    close(ch->fd);
+    ch->base = NULL;
+}
+
+int channel_state(struct channel *ch) {
+    return atomic_load_explicit(&ch->ctl->handoff, memory_order_acquire);
+}
+
+void channel_set_state(struct channel *ch, int state) {
+    atomic_store_explicit(&ch->ctl->handoff, state, memory_order_release);
+}
+
+void channel_cancel(struct channel *ch, int epoch) {
+    // Order the store after anything the master wrote for the worker before it.
+    atomic_thread_fence(memory_order_release);
+    ch->ctl->cancel = epoch;
+}
+
+void channel_wake(struct channel *ch) {
+    // The segment is shared between processes, so a non-private futex is needed.
+    syscall(SYS_futex, (int *)&ch->ctl->handoff, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+void channel_wait_state(struct channel *ch, int state) {
+    int cur;
+    while((cur = channel_state(ch)) != state) {
+        // Returns at once if the word no longer holds cur; EINTR just
+        // means that a signal handler ran, so check again.
+        syscall(SYS_futex, (int *)&ch->ctl->handoff, FUTEX_WAIT, cur, NULL, NULL, 0);
+    }
+}
+
+void *ring_reserve(struct ring *r, size_t size) {
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    size_t off = head & (r->cap - 1);
+    size_t need = ROUND(size);
+    size_t skip = need > r->cap - off ? r->cap - off : 0;
+    if(head + skip + need - tail > r->cap)
+        return NULL;
+    if(skip) {
+        *(size_t *)(r->data + off) = 0;
+        off = 0;
+    }
+    return r->data + off;
+}
+
+void ring_commit(struct ring *r, size_t size) {
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    size_t off = head & (r->cap - 1);
+    size_t need = ROUND(size);
+    if(need > r->cap - off)
+        head += r->cap - off;
+    atomic_store_explicit(&r->head, head + need, memory_order_release);
+}
+
+void *ring_peek(struct ring *r) {
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    if(tail == head)
+        return NULL;
+    size_t off = tail & (r->cap - 1);
+    if(*(size_t *)(r->data + off) == 0) {
+        // Skip marker: the message is at the start of the ring.
+        tail += r->cap - off;
+        atomic_store_explicit(&r->tail, tail, memory_order_release);
+        off = 0;
+    }
+    return r->data + off;
+}
+
+void ring_release(struct ring *r) {
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    size_t off = tail & (r->cap - 1);
+    size_t size = *(size_t *)(r->data + off);
+    atomic_store_explicit(&r->tail, tail + ROUND(size), memory_order_release);
+}
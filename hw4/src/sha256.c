@@ -0,0 +1,138 @@
+/*
+ * In-tree SHA-256 (FIPS 180-4).  See sha256.h.
+ */
+
+#include <string.h>
+
+#include "sha256.h"
+
+const uint32_t sha256_initial_state[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define CH(x, y, z) (((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x, y, z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define S0(x) (ROR(x, 2) ^ ROR(x, 13) ^ ROR(x, 22))
+#define S1(x) (ROR(x, 6) ^ ROR(x, 11) ^ ROR(x, 25))
+#define s0(x) (ROR(x, 7) ^ ROR(x, 18) ^ ((x) >> 3))
+#define s1(x) (ROR(x, 17) ^ ROR(x, 19) ^ ((x) >> 10))
+
+static uint32_t load_be32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void store_be32(unsigned char *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+/*
+ * One round, with the working variables renamed rather than shifted:
+ * each invocation names them in rotated order.
+ */
+#define ROUND(a, b, c, d, e, f, g, h, i) do {                          \
+        uint32_t t1 = h + S1(e) + CH(e, f, g) + sha256_k[i] + w[i];     \
+        d += t1;                                                        \
+        h = t1 + S0(a) + MAJ(a, b, c);                                  \
+    } while(0)
+
+#define ROUND8(i) do {                                                  \
+        ROUND(a, b, c, d, e, f, g, h, (i) + 0);                         \
+        ROUND(h, a, b, c, d, e, f, g, (i) + 1);                         \
+        ROUND(g, h, a, b, c, d, e, f, (i) + 2);                         \
+        ROUND(f, g, h, a, b, c, d, e, (i) + 3);                         \
+        ROUND(e, f, g, h, a, b, c, d, (i) + 4);                         \
+        ROUND(d, e, f, g, h, a, b, c, (i) + 5);                         \
+        ROUND(c, d, e, f, g, h, a, b, (i) + 6);                         \
+        ROUND(b, c, d, e, f, g, h, a, (i) + 7);                         \
+    } while(0)
+
+void sha256_compress(uint32_t state[8], const unsigned char *blocks, size_t nblocks) {
+    uint32_t w[64];
+    while(nblocks--) {
+        for(int i = 0; i < 16; i++)
+            w[i] = load_be32(blocks + 4 * i);
+        for(int i = 16; i < 64; i++)
+            w[i] = s1(w[i - 2]) + w[i - 7] + s0(w[i - 15]) + w[i - 16];
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for(int i = 0; i < 64; i += 8)
+            ROUND8(i);
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+        blocks += SHA256_BLOCK_SIZE;
+    }
+}
+
+void sha256_init(struct sha256_ctx *ctx) {
+    memcpy(ctx->state, sha256_initial_state, sizeof(ctx->state));
+    ctx->length = 0;
+}
+
+void sha256_update(struct sha256_ctx *ctx, const void *data, size_t len) {
+    const unsigned char *p = data;
+    size_t have = ctx->length % SHA256_BLOCK_SIZE;
+    ctx->length += len;
+    if(have) {
+        size_t n = SHA256_BLOCK_SIZE - have;
+        if(n > len)
+            n = len;
+        memcpy(ctx->buf + have, p, n);
+        p += n;
+        len -= n;
+        if(have + n < SHA256_BLOCK_SIZE)
+            return;
+        sha256_compress(ctx->state, ctx->buf, 1);
+    }
+    if(len >= SHA256_BLOCK_SIZE) {
+        sha256_compress(ctx->state, p, len / SHA256_BLOCK_SIZE);
+        p += len - len % SHA256_BLOCK_SIZE;
+        len %= SHA256_BLOCK_SIZE;
+    }
+    memcpy(ctx->buf, p, len);
+}
+
+int sha256_pad(unsigned char *buf, const void *tail, size_t tail_len, uint64_t msg_len) {
+    size_t end = SHA256_PADDED_SIZE(tail_len);
+    int nblocks = end / SHA256_BLOCK_SIZE;
+    memmove(buf, tail, tail_len);
+    buf[tail_len] = 0x80;
+    memset(buf + tail_len + 1, 0, end - tail_len - 1);
+    store_be32(buf + end - 8, (uint32_t)((msg_len * 8) >> 32));
+    store_be32(buf + end - 4, (uint32_t)(msg_len * 8));
+    return nblocks;
+}
+
+void sha256_final(struct sha256_ctx *ctx, unsigned char digest[SHA256_DIGEST_SIZE]) {
+    unsigned char buf[SHA256_PADDED_SIZE(SHA256_BLOCK_SIZE - 1)];
+    size_t have = ctx->length % SHA256_BLOCK_SIZE;
+    int nblocks = sha256_pad(buf, ctx->buf, have, ctx->length);
+    sha256_compress(ctx->state, buf, nblocks);
+    sha256_digest(ctx->state, digest);
+}
+
+void sha256_digest(const uint32_t state[8], unsigned char digest[SHA256_DIGEST_SIZE]) {
+    for(int i = 0; i < 8; i++)
+        store_be32(digest + 4 * i, state[i]);
+}
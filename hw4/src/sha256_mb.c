@@ -0,0 +1,176 @@
+/*
+ * Multi-buffer SHA-256 compression with AVX2 and AVX-512 (see sha256.h).
+ *
+ * The kernels are compiled for their instruction sets with target pragmas, so
+ * that the rest of the program can be built for the baseline architecture;
+ * sha256_mb_lanes() consults CPUID before either of them is ever called.
+ */
+
+#include <immintrin.h>
+
+#include "sha256.h"
+
+int sha256_mb_lanes(void) {
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f"))
+        return 16;
+    if(__builtin_cpu_supports("avx2"))
+        return 8;
+    return 0;
+}
+
+/*
+ * Both kernels are written in terms of the following operations on vectors of
+ * 32-bit lanes, which each section defines for its instruction set.
+ */
+#define CH(x, y, z) XOR(AND(x, y), ANDNOT(x, z))
+#define MAJ(x, y, z) OR(AND(x, y), AND(z, OR(x, y)))
+#define S0(x) XOR(XOR(ROR(x, 2), ROR(x, 13)), ROR(x, 22))
+#define S1(x) XOR(XOR(ROR(x, 6), ROR(x, 11)), ROR(x, 25))
+#define s0(x) XOR(XOR(ROR(x, 7), ROR(x, 18)), SHR(x, 3))
+#define s1(x) XOR(XOR(ROR(x, 17), ROR(x, 19)), SHR(x, 10))
+
+#define ROUND(a, b, c, d, e, f, g, h, i) do {                                  \
+        VEC t1 = ADD(ADD(ADD(h, S1(e)), ADD(CH(e, f, g), SET1(sha256_k[i]))), w[i]); \
+        d = ADD(d, t1);                                                         \
+        h = ADD(t1, ADD(S0(a), MAJ(a, b, c)));                                  \
+    } while(0)
+
+#define ROUND8(i) do {                                                          \
+        ROUND(a, b, c, d, e, f, g, h, (i) + 0);                                 \
+        ROUND(h, a, b, c, d, e, f, g, (i) + 1);                                 \
+        ROUND(g, h, a, b, c, d, e, f, (i) + 2);                                 \
+        ROUND(f, g, h, a, b, c, d, e, (i) + 3);                                 \
+        ROUND(e, f, g, h, a, b, c, d, (i) + 4);                                 \
+        ROUND(d, e, f, g, h, a, b, c, (i) + 5);                                 \
+        ROUND(c, d, e, f, g, h, a, b, (i) + 6);                                 \
+        ROUND(b, c, d, e, f, g, h, a, (i) + 7);                                 \
+    } while(0)
+
+/*
+ * Compress nblocks blocks in every lane, starting from the broadcast midstate,
+ * leaving the chaining values in s[0..7].
+ */
+#define COMPRESS(LANES) do {                                                    \
+        for(int i = 0; i < 8; i++)                                              \
+            s[i] = SET1(midstate[i]);                                           \
+        for(int blk = 0; blk < nblocks; blk++) {                                \
+            VEC w[64];                                                          \
+            for(int i = 0; i < 16; i++)                                         \
+                w[i] = LOAD(words + (blk * 16 + i) * (LANES));                  \
+            for(int i = 16; i < 64; i++)                                        \
+                w[i] = ADD(ADD(s1(w[i - 2]), w[i - 7]), ADD(s0(w[i - 15]), w[i - 16])); \
+            VEC a = s[0], b = s[1], c = s[2], d = s[3];                         \
+            VEC e = s[4], f = s[5], g = s[6], h = s[7];                         \
+            for(int i = 0; i < 64; i += 8)                                      \
+                ROUND8(i);                                                      \
+            s[0] = ADD(s[0], a);                                                \
+            s[1] = ADD(s[1], b);                                                \
+            s[2] = ADD(s[2], c);                                                \
+            s[3] = ADD(s[3], d);                                                \
+            s[4] = ADD(s[4], e);                                                \
+            s[5] = ADD(s[5], f);                                                \
+            s[6] = ADD(s[6], g);                                                \
+            s[7] = ADD(s[7], h);                                                \
+        }                                                                       \
+        for(int i = 0; i < 8; i++)                                              \
+            STORE(state + i * (LANES), s[i]);                                   \
+    } while(0)
+
+/*
+ * Mask selecting the bits of chaining value i that must be zero for a digest
+ * to have diff leading zero bits.
+ */
+static uint32_t zero_mask(int i, unsigned int diff) {
+    if(diff <= 32 * i)
+        return 0;
+    if(diff >= 32 * (i + 1))
+        return 0xffffffff;
+    return 0xffffffff << (32 - (diff - 32 * i));
+}
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+#define VEC __m256i
+#define ADD(x, y) _mm256_add_epi32(x, y)
+#define AND(x, y) _mm256_and_si256(x, y)
+#define ANDNOT(x, y) _mm256_andnot_si256(x, y)
+#define OR(x, y) _mm256_or_si256(x, y)
+#define XOR(x, y) _mm256_xor_si256(x, y)
+#define SHR(x, n) _mm256_srli_epi32(x, n)
+#define ROR(x, n) OR(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define SET1(x) _mm256_set1_epi32(x)
+#define LOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+#define STORE(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+
+static unsigned int sha256_mb_x8(const uint32_t midstate[8], const uint32_t *words,
+                                 int nblocks, unsigned int diff, uint32_t *state) {
+    VEC s[8];
+    COMPRESS(8);
+    VEC bad = _mm256_setzero_si256();
+    for(int i = 0; i < 8 && zero_mask(i, diff); i++)
+        bad = OR(bad, AND(s[i], SET1(zero_mask(i, diff))));
+    VEC ok = _mm256_cmpeq_epi32(bad, _mm256_setzero_si256());
+    return _mm256_movemask_ps(_mm256_castsi256_ps(ok));
+}
+
+#undef VEC
+#undef ADD
+#undef AND
+#undef ANDNOT
+#undef OR
+#undef XOR
+#undef SHR
+#undef ROR
+#undef SET1
+#undef LOAD
+#undef STORE
+
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+
+#define VEC __m512i
+#define ADD(x, y) _mm512_add_epi32(x, y)
+#define AND(x, y) _mm512_and_si512(x, y)
+#define ANDNOT(x, y) _mm512_andnot_si512(x, y)
+#define OR(x, y) _mm512_or_si512(x, y)
+#define XOR(x, y) _mm512_xor_si512(x, y)
+#define SHR(x, n) _mm512_srli_epi32(x, n)
+#define ROR(x, n) _mm512_ror_epi32(x, n)
+#define SET1(x) _mm512_set1_epi32(x)
+#define LOAD(p) _mm512_loadu_si512((const void *)(p))
+#define STORE(p, v) _mm512_storeu_si512((void *)(p), v)
+
+static unsigned int sha256_mb_x16(const uint32_t midstate[8], const uint32_t *words,
+                                  int nblocks, unsigned int diff, uint32_t *state) {
+    VEC s[8];
+    COMPRESS(16);
+    VEC bad = _mm512_setzero_si512();
+    for(int i = 0; i < 8 && zero_mask(i, diff); i++)
+        bad = OR(bad, AND(s[i], SET1(zero_mask(i, diff))));
+    return _mm512_testn_epi32_mask(bad, bad);
+}
+
+#undef VEC
+#undef ADD
+#undef AND
+#undef ANDNOT
+#undef OR
+#undef XOR
+#undef SHR
+#undef ROR
+#undef SET1
+#undef LOAD
+#undef STORE
+
+#pragma GCC pop_options
+
+unsigned int sha256_mb_search(int lanes, const uint32_t midstate[8], const uint32_t *words,
+                              int nblocks, unsigned int diff, uint32_t *state) {
+    if(lanes == 16)
+        return sha256_mb_x16(midstate, words, nblocks, diff, state);
+    return sha256_mb_x8(midstate, words, nblocks, diff, state);
+}
@@ -0,0 +1,75 @@
+/*
+ * SHA-256 compression with the x86 SHA extensions (see sha256.h).
+ *
+ * As with the multi-buffer kernels, the code is compiled for the instructions
+ * it needs with a target pragma, and sha256_ni_supported() consults CPUID
+ * before it is ever called.
+ */
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+#include "sha256.h"
+
+int sha256_ni_supported(void) {
+    unsigned int eax, ebx, ecx, edx;
+    // SSSE3 and SSE4.1 are needed for byte swapping and blending.
+    if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return 0;
+    if(!(ecx & bit_SSSE3) || !(ecx & bit_SSE4_1))
+        return 0;
+    if(!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+        return 0;
+    return (ebx & bit_SHA) != 0;
+}
+
+#pragma GCC push_options
+#pragma GCC target("sha,ssse3,sse4.1")
+
+/*
+ * The SHA extensions keep the working variables as two vectors, ABEF and CDGH.
+ * Each group of four rounds consumes one vector of message words (msg[g % 4] for
+ * group g), and meanwhile advances the message schedule: msg1 for the vector
+ * needed three groups later, and the alignr/add/msg2 step for the vector needed
+ * in the next group.
+ */
+void sha256_compress_ni(uint32_t state[8], const unsigned char *blocks, size_t nblocks) {
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i tmp = _mm_loadu_si128((const __m128i *)&state[0]);
+    __m128i st1 = _mm_loadu_si128((const __m128i *)&state[4]);
+    tmp = _mm_shuffle_epi32(tmp, 0xb1);         // CDAB
+    st1 = _mm_shuffle_epi32(st1, 0x1b);         // EFGH
+    __m128i st0 = _mm_alignr_epi8(tmp, st1, 8); // ABEF
+    st1 = _mm_blend_epi16(st1, tmp, 0xf0);      // CDGH
+    while(nblocks--) {
+        __m128i abef = st0, cdgh = st1;
+        __m128i msg[4], m;
+#pragma GCC unroll 16
+        for(int g = 0; g < 16; g++) {
+            if(g < 4)
+                msg[g] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(blocks + 16 * g)), bswap);
+            m = _mm_add_epi32(msg[g % 4], _mm_loadu_si128((const __m128i *)&sha256_k[4 * g]));
+            st1 = _mm_sha256rnds2_epu32(st1, st0, m);
+            if(g >= 3 && g <= 14) {
+                tmp = _mm_alignr_epi8(msg[g % 4], msg[(g + 3) % 4], 4);
+                msg[(g + 1) % 4] = _mm_add_epi32(msg[(g + 1) % 4], tmp);
+                msg[(g + 1) % 4] = _mm_sha256msg2_epu32(msg[(g + 1) % 4], msg[g % 4]);
+            }
+            m = _mm_shuffle_epi32(m, 0x0e);
+            st0 = _mm_sha256rnds2_epu32(st0, st1, m);
+            if(g >= 1 && g <= 12)
+                msg[(g + 3) % 4] = _mm_sha256msg1_epu32(msg[(g + 3) % 4], msg[g % 4]);
+        }
+        st0 = _mm_add_epi32(st0, abef);
+        st1 = _mm_add_epi32(st1, cdgh);
+        blocks += SHA256_BLOCK_SIZE;
+    }
+    tmp = _mm_shuffle_epi32(st0, 0x1b);         // FEBA
+    st1 = _mm_shuffle_epi32(st1, 0xb1);         // DCHG
+    st0 = _mm_blend_epi16(tmp, st1, 0xf0);      // DCBA
+    st1 = _mm_alignr_epi8(st1, tmp, 8);         // HGFE
+    _mm_storeu_si128((__m128i *)&state[0], st0);
+    _mm_storeu_si128((__m128i *)&state[4], st1);
+}
+
+#pragma GCC pop_options
@@ -0,0 +1,181 @@
+/*
+ * Metrics segment (see stats.h).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "debug.h"
+#include "polya.h"
+#include "stats.h"
+
+static struct stats_segment *seg;
+static int seg_fd = -1;
+
+// Entry in the segment of the calling thread, when it is a worker.
+static _Thread_local int self = -1;
+
+// Only async-signal-safe functions are used, so that these may be called
+// from anywhere.
+static uint64_t now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void put(_Atomic uint64_t *p, uint64_t v) {
+    atomic_store_explicit(p, v, memory_order_relaxed);
+}
+
+static uint64_t get(_Atomic uint64_t *p) {
+    return atomic_load_explicit(p, memory_order_relaxed);
+}
+
+/*
+ * stats_create
+ * (See stats.h for specification.)
+ */
+int stats_create(int nworkers) {
+    char name[64];
+    size_t size = STATS_SEGMENT_SIZE(nworkers);
+    snprintf(name, sizeof(name), STATS_NAME_FMT, getpid());
+    if((seg_fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0600)) < 0)
+        return -1;
+    if(ftruncate(seg_fd, size) < 0
+       || (seg = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, seg_fd, 0)) == MAP_FAILED) {
+        close(seg_fd);
+        shm_unlink(name);
+        seg = NULL;
+        seg_fd = -1;
+        return -1;
+    }
+    seg->master_pid = getpid();
+    seg->nworkers = nworkers;
+    seg->start = now();
+    seg->version = STATS_VERSION;
+    // The magic number goes in last, so that a reader never sees a partly
+    // initialized header.
+    atomic_thread_fence(memory_order_release);
+    seg->magic = STATS_MAGIC;
+    debug("[%d:Master] Metrics segment %s", getpid(), name);
+    return seg_fd;
+}
+
+/*
+ * stats_destroy
+ * (See stats.h for specification.)
+ */
+void stats_destroy(void) {
+    char name[64];
+    if(seg == NULL)
+        return;
+    snprintf(name, sizeof(name), STATS_NAME_FMT, getpid());
+    shm_unlink(name);
+    munmap(seg, STATS_SEGMENT_SIZE(seg->nworkers));
+    close(seg_fd);
+    seg = NULL;
+    seg_fd = -1;
+}
+
+int stats_fd(void) {
+    return seg_fd;
+}
+
+void stats_worker_started(int worker, int pid) {
+    if(seg == NULL)
+        return;
+    struct stats_worker *sw = &seg->workers[worker];
+    put(&sw->state_since, now());
+    atomic_store_explicit(&sw->pid, pid, memory_order_relaxed);
+}
+
+void stats_change_state(int worker, int state) {
+    if(seg == NULL)
+        return;
+    struct stats_worker *sw = &seg->workers[worker];
+    uint64_t t = now();
+    int old = atomic_load_explicit(&sw->state, memory_order_relaxed);
+    if(old >= 0 && old < STATS_NSTATES)
+        put(&sw->state_time[old], get(&sw->state_time[old]) + (t - get(&sw->state_since)));
+    put(&sw->state_since, t);
+    atomic_store_explicit(&sw->state, state, memory_order_relaxed);
+}
+
+void stats_dispatch(int worker) {
+    if(seg == NULL)
+        return;
+    put(&seg->workers[worker].dispatched, now());
+    put(&seg->dispatched, get(&seg->dispatched) + 1);
+}
+
+void stats_result(int worker, int failed, int canceled) {
+    if(seg == NULL)
+        return;
+    struct stats_worker *sw = &seg->workers[worker];
+    uint64_t sent = get(&sw->dispatched);
+    put(&sw->results, get(&sw->results) + 1);
+    if(!failed)
+        put(&seg->solved, get(&seg->solved) + 1);
+    else if(canceled)
+        put(&seg->canceled, get(&seg->canceled) + 1);
+    else
+        put(&seg->failed, get(&seg->failed) + 1);
+    if(sent == 0)
+        return;
+    uint64_t v = now() - sent;
+    struct stats_histogram *h = &seg->latency;
+    int b = stats_bucket(v);
+    put(&h->buckets[b], get(&h->buckets[b]) + 1);
+    put(&h->sum, get(&h->sum) + v);
+    if(v > get(&h->max))
+        put(&h->max, v);
+    // The count goes last, so that it never exceeds the sum of the buckets.
+    put(&h->count, get(&h->count) + 1);
+    put(&sw->dispatched, 0);
+}
+
+/*
+ * stats_attach
+ * (See stats.h for specification.)
+ */
+void stats_attach(void) {
+    char *fd = getenv(STATS_FD_ENV);
+    char *slot = getenv(STATS_SLOT_ENV);
+    if(fd == NULL || slot == NULL)
+        return;
+    struct stats_segment *s;
+    // The header is mapped first, to find out how many workers there are.
+    s = mmap(NULL, sizeof(*s), PROT_READ, MAP_SHARED, atoi(fd), 0);
+    if(s == MAP_FAILED)
+        return;
+    size_t size = STATS_SEGMENT_SIZE(s->nworkers);
+    munmap(s, sizeof(*s));
+    s = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, atoi(fd), 0);
+    close(atoi(fd));
+    if(s == MAP_FAILED)
+        return;
+    seg = s;
+    self = atoi(slot);
+}
+
+void stats_set_worker(int worker) {
+    self = worker;
+}
+
+/*
+ * stats_report_hashes
+ * (See stats.h for specification.)
+ */
+void stats_report_hashes(long hashes, double secs) {
+    if(seg == NULL || self < 0)
+        return;
+    struct stats_worker *sw = &seg->workers[self];
+    put(&sw->hashes, get(&sw->hashes) + hashes);
+    put(&sw->hash_time, get(&sw->hash_time) + (uint64_t)(secs * 1e9));
+    put(&sw->last_rate, secs > 0 ? (uint64_t)(hashes / secs) : 0);
+}
@@ -0,0 +1,289 @@
+/*
+ * Thread mode of the master (polya -m threads).
+ *
+ * Problems are solved on a pool of threads within the master process rather
+ * than by worker processes.  Each thread has a handoff word, on which it waits
+ * with a futex while idle; the master thread copies a problem into the thread's
+ * buffer and moves the word to WORKER_CONTINUED.  A thread that has finished
+ * pushes itself onto a lock-free completion stack, which the master thread
+ * empties all at once, so that neither side ever takes a lock.  Cancellation
+ * is through a per-thread flag polled by the solver, as with a channel.
+ *
+ * All sf_* events are reported by the master thread.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "debug.h"
+#include "polya.h"
+#include "master.h"
+#include "pool.h"
+#include "worker.h"
+#include "placement.h"
+#include "stats.h"
+#include "trace.h"
+
+// Threads have no PIDs, so they are reported to sf_* with IDs beyond the
+// largest PID that Linux will ever assign (PID_MAX_LIMIT).
+#define THREAD_ID_BASE (1 << 22)
+
+/*
+ * State kept for each thread in the pool.
+ */
+struct pool_thread {
+    pthread_t thread;
+    int id;                         // Synthetic ID reported in sf_* events.
+    int state;                      // WORKER_* state, as last reported.
+    struct problem *prob;           // Problem being worked on, as given by the pool.
+    int var;                        // Variant of the problem being worked on.
+    struct problem *copy;           // The thread's own copy of the problem.
+    size_t copy_cap;                // Capacity of the copy.
+    struct result *res;             // Result of the thread, once finished.
+    struct pool_thread *next;       // Next on the completion stack.
+    // Set by the master thread to the state the thread should be in:
+    // WORKER_CONTINUED to solve the problem in its copy, WORKER_EXITED to exit.
+    // The thread sets it to WORKER_IDLE or WORKER_STOPPED when it has finished.
+    _Alignas(64) _Atomic int handoff;
+    volatile sig_atomic_t cancel;   // Cancellation flag polled by the solver.
+};
+
+static struct pool_thread *threads;
+static int nthreads;
+
+// Threads that have finished, most recent first.
+static _Atomic(struct pool_thread *) completed;
+// Incremented each time a thread is pushed onto the completion stack.
+static _Atomic int completed_seq;
+// Set while the master thread is waiting on completed_seq.
+static _Atomic int master_waiting;
+
+// Idle threads, most recent last.
+static int *idle_list;
+static int nidle;
+
+static void futex_wait(_Atomic int *word, int val) {
+    syscall(SYS_futex, (int *)word, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void futex_wake(_Atomic int *word) {
+    syscall(SYS_futex, (int *)word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+/*
+ * Publish the end of a thread's current piece of work to the master thread.
+ */
+static void complete(struct pool_thread *t, int state) {
+    atomic_store(&t->handoff, state);
+    struct pool_thread *head = atomic_load(&completed);
+    do {
+        t->next = head;
+    } while(!atomic_compare_exchange_weak(&completed, &head, t));
+    atomic_fetch_add(&completed_seq, 1);
+    if(atomic_load(&master_waiting))
+        futex_wake(&completed_seq);
+}
+
+static void *thread_main(void *arg) {
+    struct pool_thread *t = arg;
+    stats_set_worker((int)(t - threads));
+    complete(t, WORKER_IDLE);
+    while(1) {
+        int h;
+        while((h = atomic_load(&t->handoff)) != WORKER_CONTINUED && h != WORKER_EXITED)
+            futex_wait(&t->handoff, h);
+        if(h == WORKER_EXITED)
+            return NULL;
+        debug("[%d:Thread %d] Solving problem %d", getpid(), t->id, t->copy->id);
+        t->res = solve_problem(t->copy, &t->cancel);
+        complete(t, WORKER_STOPPED);
+    }
+}
+
+static void set_state(struct pool_thread *t, int state) {
+    sf_change_state(t->id, t->state, state);
+    stats_change_state((int)(t - threads), state);
+    trace_event(TRACE_STATE, (int)(t - threads), t->id, t->prob ? t->prob->id : -1,
+                t->prob ? t->var : -1, state);
+    t->state = state;
+    if(state == WORKER_IDLE)
+        idle_list[nidle++] = (int)(t - threads);
+}
+
+/*
+ * Hand a problem to an idle thread.
+ */
+static void send_problem(struct pool_thread *t, struct problem *prob, int var) {
+    if(t->copy_cap < prob->size) {
+        if((t->copy = realloc(t->copy, prob->size)) == NULL) {
+            perror("Master problem copy alloc error");
+            exit(EXIT_FAILURE);
+        }
+        t->copy_cap = prob->size;
+    }
+    trace_event(TRACE_SEND, (int)(t - threads), t->id, prob->id, var, 0);
+    memcpy(t->copy, prob, prob->size);
+    t->prob = prob;
+    t->var = var;
+    t->cancel = 0;
+    set_state(t, WORKER_CONTINUED);
+    sf_send_problem(t->id, prob);
+    stats_dispatch((int)(t - threads));
+    atomic_store(&t->handoff, WORKER_CONTINUED);
+    futex_wake(&t->handoff);
+    trace_event(TRACE_CONTINUE, (int)(t - threads), t->id, prob->id, var, 0);
+    // There is no separate notice of the thread starting to run.
+    set_state(t, WORKER_RUNNING);
+}
+
+/*
+ * Cancel the threads still busy with a problem that has just been solved.
+ */
+static void cancel_threads(struct problem *solved) {
+    for(int i = 0; i < nthreads; i++) {
+        struct pool_thread *t = &threads[i];
+        if(t->prob == solved && t->state == WORKER_RUNNING) {
+            sf_cancel(t->id);
+            trace_event(TRACE_CANCEL, i, t->id, solved->id, t->var, 0);
+            atomic_thread_fence(memory_order_release);
+            t->cancel = 1;
+        }
+    }
+}
+
+/*
+ * Deal with a thread that has come off the completion stack.
+ */
+static void finish_thread(struct pool_thread *t) {
+    if(t->state == WORKER_STARTED) {
+        set_state(t, WORKER_IDLE);
+        return;
+    }
+    int index = (int)(t - threads);
+    set_state(t, WORKER_STOPPED);
+    sf_recv_result(t->id, t->res);
+    stats_result(index, t->res->failed, t->cancel);
+    // The acknowledgement comes first, so that it falls within the problem.
+    if(t->cancel)
+        trace_event(TRACE_CANCEL_ACK, index, t->id, t->prob->id, t->var, 0);
+    trace_event(TRACE_RESULT, index, t->id, t->prob->id, t->var, t->res->failed);
+    set_state(t, WORKER_IDLE);
+    struct problem *prob = t->prob;
+    t->prob = NULL;
+    int id = prob->id;
+    int posted = post_pool_result(t->res, prob, t->var);
+    trace_event(TRACE_POST, index, t->id, id, t->var, posted);
+    if(posted == 0)
+        cancel_threads(prob);
+    free(t->res);
+    t->res = NULL;
+}
+
+/*
+ * Wait until at least one thread has completed, then finish every thread
+ * that has.
+ */
+static void collect_completed(void) {
+    struct pool_thread *list;
+    while(1) {
+        int seq = atomic_load(&completed_seq);
+        if((list = atomic_exchange(&completed, NULL)) != NULL)
+            break;
+        atomic_store(&master_waiting, 1);
+        if(atomic_load(&completed) == NULL)
+            futex_wait(&completed_seq, seq);
+        atomic_store(&master_waiting, 0);
+    }
+    while(list != NULL) {
+        struct pool_thread *t = list;
+        list = t->next;
+        finish_thread(t);
+    }
+}
+
+/*
+ * Assign problems to idle threads.
+ * @return 0 if there are no more problems to be solved, otherwise 1.
+ */
+static int assign_problems(void) {
+    while(nidle > 0) {
+        int var;
+        struct problem *prob = get_pool_variant(nthreads, &var);
+        if(prob == NULL)
+            break;
+        send_problem(&threads[idle_list[--nidle]], prob, var);
+    }
+    return !pool_exhausted();
+}
+
+/*
+ * master_threads
+ * (See master.h for specification.)
+ */
+int master_threads(int n) {
+    sf_start();
+    nthreads = n > 0 ? n : 1;
+    if((threads = calloc(nthreads, sizeof(struct pool_thread))) == NULL
+       || (idle_list = calloc(nthreads, sizeof(int))) == NULL) {
+        perror("Master thread table alloc error");
+        exit(EXIT_FAILURE);
+    }
+    placement_init(master_placement, nthreads);
+    if(master_metrics && stats_create(nthreads) < 0)
+        perror("Can't create metrics segment");
+    if(master_trace && trace_open(master_trace, nthreads) < 0)
+        perror("Can't create trace file");
+    for(int i = 0; i < nthreads; i++) {
+        struct pool_thread *t = &threads[i];
+        t->id = THREAD_ID_BASE + i;
+        t->state = 0;
+        stats_worker_started(i, t->id);
+        set_state(t, WORKER_STARTED);
+        placement_enter(i);
+        int err = pthread_create(&t->thread, NULL, thread_main, t);
+        placement_leave();
+        if(err != 0) {
+            errno = err;
+            perror("pthread_create error");
+            exit(EXIT_FAILURE);
+        }
+        placement_report(i, t->id);
+    }
+
+    // Threads never die, so every thread that is neither idle nor yet to
+    // report in is busy with a problem.
+    int more = 1;
+    while(1) {
+        if(more)
+            more = assign_problems();
+        if(!more && nidle == nthreads)
+            break;
+        collect_completed();
+    }
+
+    debug("[%d:Master] All threads are idle -- terminating", getpid());
+    for(int i = 0; i < nthreads; i++) {
+        struct pool_thread *t = &threads[i];
+        atomic_store(&t->handoff, WORKER_EXITED);
+        futex_wake(&t->handoff);
+    }
+    for(int i = 0; i < nthreads; i++) {
+        struct pool_thread *t = &threads[i];
+        pthread_join(t->thread, NULL);
+        set_state(t, WORKER_EXITED);
+        free(t->copy);
+    }
+    free(threads);
+    free(idle_list);
+    stats_destroy();
+    trace_close();
+    sf_end();
+    return EXIT_SUCCESS;
+}
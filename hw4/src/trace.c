@@ -0,0 +1,98 @@
+/*
+ * Trace recorder (see trace.h).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "debug.h"
+#include "trace.h"
+
+#define TRACE_SIZE (sizeof(struct trace_header) + (size_t)TRACE_MAX_RECORDS * sizeof(struct trace_record))
+
+static struct trace_header *header;
+static struct trace_record *records;
+static char *trace_path;
+
+static uint64_t clock_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * trace_open
+ * (See trace.h for specification.)
+ */
+int trace_open(const char *path, int nworkers) {
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0)
+        return -1;
+    if(ftruncate(fd, TRACE_SIZE) < 0
+       || (header = mmap(NULL, TRACE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        close(fd);
+        header = NULL;
+        return -1;
+    }
+    close(fd);
+    if((trace_path = strdup(path)) == NULL) {
+        munmap(header, TRACE_SIZE);
+        header = NULL;
+        return -1;
+    }
+    records = (struct trace_record *)(header + 1);
+    header->magic = TRACE_MAGIC;
+    header->version = TRACE_VERSION;
+    header->master_pid = getpid();
+    header->nworkers = nworkers;
+    header->start_mono = clock_ns(CLOCK_MONOTONIC);
+    header->start_real = clock_ns(CLOCK_REALTIME);
+    debug("[%d:Master] Tracing to %s", getpid(), path);
+    return 0;
+}
+
+/*
+ * trace_close
+ * (See trace.h for specification.)
+ */
+void trace_close(void) {
+    if(header == NULL)
+        return;
+    uint64_t n = atomic_load(&header->nrecords);
+    if(n > TRACE_MAX_RECORDS) {
+        fprintf(stderr, "Trace: %lu events dropped\n", n - TRACE_MAX_RECORDS);
+        n = TRACE_MAX_RECORDS;
+    }
+    munmap(header, TRACE_SIZE);
+    if(truncate(trace_path, sizeof(struct trace_header) + n * sizeof(struct trace_record)) < 0)
+        perror("Trace truncate error");
+    free(trace_path);
+    header = NULL;
+    records = NULL;
+    trace_path = NULL;
+}
+
+/*
+ * trace_event
+ * (See trace.h for specification.)
+ */
+void trace_event(int event, int worker, int pid, int prob, int var, int arg) {
+    if(header == NULL)
+        return;
+    uint64_t i = atomic_fetch_add_explicit(&header->nrecords, 1, memory_order_relaxed);
+    if(i >= TRACE_MAX_RECORDS)
+        return;
+    struct trace_record *r = &records[i];
+    r->time = clock_ns(CLOCK_MONOTONIC);
+    r->event = event;
+    r->prob = prob;
+    r->var = var;
+    r->worker = worker;
+    r->pid = pid;
+    r->arg = arg;
+}
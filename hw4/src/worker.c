@@ -1,11 +1,20 @@
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "debug.h"
 #include "polya.h"
+#include "ring.h"
+#include "worker.h"
+#include "stats.h"
 
 volatile sig_atomic_t canceledp = 0;
 volatile sig_atomic_t done = 0;
 
+// eventfd on which to notify the master when using futex handoff, or -1.
+static int doorbell = -1;
+
 // SIGHUP handler
 // signal sent by master process to notify a worker to cancel its current solution attempt
 void sighup_handler(int sig) {
@@ -27,6 +36,113 @@ void sigterm_handler(int sig) {
     exit(EXIT_SUCCESS);
 }
 
+/*
+ * Read a problem from the problem pipe (stdin).
+ * Returns the problem, in storage obtained from malloc.
+ */
+static struct problem *read_problem(void) {
+    // read sizeof(struct problem) bytes from the input and store it into a struct problem variable
+    // malloc to get header
+    struct problem *m_problem = (struct problem*) malloc(sizeof(struct problem));
+    if (m_problem == NULL) {
+        perror("Child problem header malloc error");
+        exit(EXIT_FAILURE);
+    }
+    debug("Reading problem");
+    debug("Reading data (nbytes = %ld%s", sizeof(struct problem), ")");
+    // 1. read the header
+    fread(m_problem, sizeof(struct problem), 1, stdin); // ptr, size (each size bytes long), nmemb (items of data), stream
+    //ferror
+    if (ferror(stdin)) {
+        perror("ferror");
+        exit(EXIT_FAILURE);
+    }
+    // examine the size field of this structure and read an additional size
+    // 2. malloc storage for the full problem (header + data)
+    // 3. copy the already-read header into the beginning of the malloc'ed area
+    m_problem = realloc(m_problem, m_problem->size); // realloc for new size (header + data)
+    if (m_problem == NULL) {
+        perror("Child problem realloc error");
+        exit(EXIT_FAILURE);
+    }
+    // 4. read the remaining data into the rest of the malloc'ed area
+    fread(m_problem->data, (m_problem->size - sizeof(struct problem)), 1, stdin);
+    //ferror
+    if (ferror(stdin)) {
+        perror("ferror");
+        exit(EXIT_FAILURE);
+    }
+    return m_problem;
+}
+
+/*
+ * Write a result to the result pipe (stdout).
+ */
+static void write_result(struct result *result) {
+    fwrite(result, result->size, 1, stdout);
+    // ferror
+    if (ferror(stdout)) {
+        perror("ferror");
+        exit(EXIT_FAILURE);
+    }
+    if (fflush(stdout) == EOF) {
+        perror("fflush error");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * solve_problem
+ * (See worker.h for specification.)
+ */
+struct result *solve_problem(struct problem *prob, volatile sig_atomic_t *canceledp) {
+    struct result *result = solvers[prob->type].solve(prob, canceledp);
+    if (result == NULL) {
+        // canceled or failed: send back just a header marked "failed"
+        result = (struct result *) calloc(1, sizeof(struct result));
+        if (result == NULL) {
+            perror("Child result malloc error");
+            exit(EXIT_FAILURE);
+        }
+        result->size = sizeof(struct result);
+        result->failed = 1;
+    }
+    result->id = prob->id;
+    if (*canceledp) {
+        debug("Canceled (epoch %d)", *canceledp);
+        result->failed = 1;
+    }
+    return result;
+}
+
+/*
+ * Wait for the master to send a problem.
+ * Normally the worker stops itself with SIGSTOP and the master continues it.
+ * With futex handoff, the new state (idle or stopped) is published in the
+ * channel, the master is notified through the doorbell, and the worker parks
+ * on the channel until the master moves it to WORKER_CONTINUED.
+ *
+ * @param chan  The channel, or NULL if pipes are used.
+ * @param state  WORKER_IDLE initially, WORKER_STOPPED after sending a result.
+ */
+static void await_problem(struct channel *chan, int state) {
+    if (doorbell >= 0) {
+        uint64_t one = 1;
+        channel_set_state(chan, state);
+        if (write(doorbell, &one, sizeof(one)) < 0) {
+            perror("Child could not ring doorbell");
+            exit(EXIT_FAILURE);
+        }
+        channel_wait_state(chan, WORKER_CONTINUED);
+        channel_set_state(chan, WORKER_RUNNING);
+        return;
+    }
+    if (raise(SIGSTOP) != 0) {
+        perror("Child could not send SIGSTOP to itself");
+        exit(EXIT_FAILURE);
+    }
+}
+
 /*
  * worker
  * (See polya.h for specification.)
@@ -47,11 +163,24 @@ int worker(void) {
 
     debug("Starting");
     done = 0;
-    sigset_t sighup_mask;
-    sigset_t orig_mask;
-    sigemptyset(&sighup_mask);
-    sigaddset(&sighup_mask, SIGHUP);
+    // Map the metrics segment, if the master keeps one.
+    stats_attach();
 
+    // If the master set up a shared-memory channel, problems and results
+    // are exchanged through its rings instead of stdin and stdout.
+    struct channel channel;
+    struct channel *chan = NULL;
+    char *chan_fd = getenv(CHANNEL_FD_ENV);
+    if (chan_fd != NULL) {
+        if (channel_attach(&channel, atoi(chan_fd)) < 0) {
+            perror("Child could not attach channel");
+            exit(EXIT_FAILURE);
+        }
+        chan = &channel;
+        char *bell_fd = getenv(DOORBELL_FD_ENV);
+        if (bell_fd != NULL)
+            doorbell = atoi(bell_fd);
+    }
     if (signal(SIGTERM, sigterm_handler) == SIG_ERR) { // Install the handler
         perror("signal_error");
         exit(EXIT_FAILURE);
@@ -65,11 +194,8 @@ int worker(void) {
 
     // performs required initilization, then stops by sending itself a SIGSTOP signal
     // idle
-    debug("Idling (sending SIGSTOP to self)");
-    if (raise(SIGSTOP) != 0) {
-        perror("Child could not send SIGSTOP to itself");
-        exit(EXIT_FAILURE);
-    }
+    debug("Idling");
+    await_problem(chan, WORKER_IDLE);
 
     // upon continuing (when the master process sends a SIGCONT signal)
         // it reads a problem sent by the master and attempts to solve the problem
@@ -83,63 +209,26 @@ int worker(void) {
     // worker sends a result to the master is symmetric
 
     while (done == 0) {
-        // canceledp = 0;
-        // read sizeof(struct problem) bytes from the input and store it into a struct problem variable
-        // malloc to get header
-        struct problem *m_problem = (struct problem*) malloc(sizeof(struct problem));
+        struct problem *m_problem = chan ? ring_peek(chan->problems) : read_problem();
         if (m_problem == NULL) {
-            perror("Child problem header malloc error");
-            exit(EXIT_FAILURE);
-        }
-        debug("Reading problem");
-        debug("Reading data (nbytes = %ld%s", sizeof(struct problem), ")");
-        // 1. read the header
-        fread(m_problem, sizeof(struct problem), 1, stdin); // ptr, size (each size bytes long), nmemb (items of data), stream
-        //ferror
-        if (ferror(stdin)) {
-            perror("ferror");
-            exit(EXIT_FAILURE);
-        }
-        // examine the size field of this structure and read an additional size
-        // 2. malloc storage for the full problem (header + data)
-        // 3. copy the already-read header into the beginning of the malloc'ed area
-        m_problem = realloc(m_problem, m_problem->size); // realloc for new size (header + data)
-        if (m_problem == NULL) {
-            perror("Child problem realloc error");
-            exit(EXIT_FAILURE);
+            debug("Continued with no problem to solve");
+            await_problem(chan, WORKER_STOPPED);
+            continue;
         }
         debug("Got problem: size = %ld%s%d%s%d", m_problem->size, ", type = ", m_problem->type, ", variants = ", m_problem->nvars);
-        // 4. read the remaining data into the rest of the malloc'ed area
-        fread(m_problem->data, (m_problem->size - sizeof(struct problem)), 1, stdin);
-        //ferror
-        if (ferror(stdin)) {
-            perror("ferror");
-            exit(EXIT_FAILURE);
-        }
-        if (fflush(stdin) == EOF) {
-            perror("fflush error");
-            exit(EXIT_FAILURE);
-        }
+        // Any cancellation that arrived before this problem was read
+        // refers to an earlier problem.
+        canceledp = 0;
         debug("Solving problem");
         // SOLVING
-        if (sigprocmask(SIG_BLOCK, &sighup_mask, &orig_mask) < 0) { // block
-            perror("sigprocmask");
-            exit(EXIT_FAILURE);
-        }
-        volatile sig_atomic_t *canceledp_ptr = &canceledp;
-        struct result *solver = (struct result *)(solvers[m_problem->type].solve(m_problem, canceledp_ptr));
-        if (sigprocmask(SIG_SETMASK, &orig_mask, NULL) < 0) { // unblock
-            perror("sigprocmask");
-            exit(EXIT_FAILURE);
-        }
-        if (canceledp == 1) {
-            solver->failed = 1;
+        // With a channel, the solver polls the cancellation word that the
+        // master sets (see ring.h), which the master has already cleared for
+        // this problem.  Otherwise SIGHUP is left unblocked so that the solver
+        // sees a cancellation as soon as it is requested.
+        volatile sig_atomic_t *canceledp_ptr = chan ? &chan->ctl->cancel : &canceledp;
+        struct result *solver = solve_problem(m_problem, canceledp_ptr);
+        if (*canceledp_ptr)
             canceledp = 0;
-        }
-        //debug("%ld", solver->size);
-        //debug("%d", solver->id);
-        //debug("%d", solver->failed); // 0 if result not "failed", nonzero if result "failed"
-        //debug("%s", solver->data);
 
         // continues the solution attempt until it either succeeds in finding a solution,
             // fails to find a solution, or is notified (by the master sending SIGHUP to cancel)
@@ -150,25 +239,24 @@ int worker(void) {
         // 3) (SIGHUP) the master process notifies the worker ot cancel the solution procedure
 
         // WRITING A RESULT
-        fwrite(solver, solver->size, 1, stdout);
-        // ferror
-        if (ferror(stdout)) {
-            perror("ferror");
-            exit(EXIT_FAILURE);
+        if (chan) {
+            void *slot = ring_reserve(chan->results, solver->size);
+            if (slot == NULL) {
+                debug("No room in channel for result (size = %ld)", solver->size);
+                exit(EXIT_FAILURE);
+            }
+            memcpy(slot, solver, solver->size);
+            ring_commit(chan->results, solver->size);
+            ring_release(chan->problems);
+        } else {
+            write_result(solver);
+            free(m_problem);
         }
-        if (fflush(stdout) == EOF) {
-            perror("fflush error");
-            exit(EXIT_FAILURE);
-        }
-        free(m_problem);
         free(solver);
 
         // send result to the master process
-        debug("Raised SIGSTOP");
-        if (raise(SIGSTOP) != 0) {
-            perror("Child could not send SIGSTOP to itself");
-            exit(EXIT_FAILURE);
-        }
+        debug("Stopping");
+        await_problem(chan, WORKER_STOPPED);
     }
 
     return EXIT_FAILURE;
@@ -53,3 +53,139 @@ Test(demo_master_suite, miner_test_three_workers) {
                  "Program exited with %d instead of EXIT_SUCCESS",
 		 return_code);
 }
+
+Test(master_mode_suite, miner_test_spin_mode) {
+    char *cmd = "bin/polya -p 5 -t 2 -w 3 -m spin";
+    int return_code = WEXITSTATUS(system(cmd));
+
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Program exited with %d instead of EXIT_SUCCESS",
+		 return_code);
+}
+
+Test(master_mode_suite, miner_test_shm_transport) {
+    char *cmd = "bin/polya -p 5 -t 2 -w 3 -c shm";
+    int return_code = WEXITSTATUS(system(cmd));
+
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Program exited with %d instead of EXIT_SUCCESS",
+		 return_code);
+}
+
+Test(master_mode_suite, miner_test_futex_handoff) {
+    char *cmd = "bin/polya -p 5 -t 2 -w 3 -H futex";
+    int return_code = WEXITSTATUS(system(cmd));
+
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Program exited with %d instead of EXIT_SUCCESS",
+		 return_code);
+}
+
+Test(master_mode_suite, miner_test_problem_pool) {
+    char *cmd = "bin/polya -p 5 -t 2 -w 4 -k 2";
+    int return_code = WEXITSTATUS(system(cmd));
+
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Program exited with %d instead of EXIT_SUCCESS",
+		 return_code);
+}
+
+Test(master_mode_suite, miner_test_forced_backend) {
+    char *cmd = "bin/polya -p 5 -t 2 -w 3 -b gcrypt";
+    int return_code = WEXITSTATUS(system(cmd));
+
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Program exited with %d instead of EXIT_SUCCESS",
+		 return_code);
+}
+
+Test(master_mode_suite, miner_test_chunked_ranges) {
+    char *cmd = "bin/polya -p 5 -t 2 -w 3 -r 20";
+    int return_code = WEXITSTATUS(system(cmd));
+
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Program exited with %d instead of EXIT_SUCCESS",
+		 return_code);
+}
+
+Test(master_mode_suite, miner_test_many_workers) {
+    char *cmd = "bin/polya -p 5 -t 2 -w 40";
+    int return_code = WEXITSTATUS(system(cmd));
+
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Program exited with %d instead of EXIT_SUCCESS",
+		 return_code);
+}
+
+Test(master_mode_suite, miner_test_fork_start) {
+    char *cmd = "bin/polya -p 5 -t 2 -w 3 -s fork";
+    int return_code = WEXITSTATUS(system(cmd));
+
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Program exited with %d instead of EXIT_SUCCESS",
+		 return_code);
+}
+
+Test(master_mode_suite, miner_test_threads_mode) {
+    char *cmd = "bin/polya -p 5 -t 2 -w 3 -m threads";
+    int return_code = WEXITSTATUS(system(cmd));
+
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Program exited with %d instead of EXIT_SUCCESS",
+		 return_code);
+}
+
+Test(master_mode_suite, miner_test_threaded_search) {
+    char *cmd = "bin/polya -p 5 -t 2 -w 2 -j 3";
+    int return_code = WEXITSTATUS(system(cmd));
+
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Program exited with %d instead of EXIT_SUCCESS",
+		 return_code);
+}
+
+Test(master_mode_suite, miner_test_placement) {
+    char *cmd = "bin/polya -p 5 -t 2 -w 3 -P smt-spread";
+    int return_code = WEXITSTATUS(system(cmd));
+
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Program exited with %d instead of EXIT_SUCCESS",
+		 return_code);
+}
+
+Test(master_mode_suite, miner_test_metrics) {
+    char *cmd = "bin/polya -p 5 -t 2 -w 3 -M";
+    int return_code = WEXITSTATUS(system(cmd));
+
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Program exited with %d instead of EXIT_SUCCESS",
+		 return_code);
+}
+
+Test(master_mode_suite, miner_test_fixed_workload) {
+    char *cmd = "bin/polya -p 5 -t 2 -w 2 -S 1 -d 18";
+    int return_code = WEXITSTATUS(system(cmd));
+
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Program exited with %d instead of EXIT_SUCCESS",
+		 return_code);
+}
+
+Test(master_mode_suite, miner_test_workload_mix) {
+    char *cmd = "bin/polya -p 10 -w 2 -S 7 -T 1:2,2 -B 32:3,64-100 -N 4-8 -d 14-17";
+    int return_code = WEXITSTATUS(system(cmd));
+
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Program exited with %d instead of EXIT_SUCCESS",
+		 return_code);
+}
+
+Test(master_mode_suite, miner_test_trace) {
+    char *cmd = "bin/polya -p 5 -t 2 -w 3 -R /tmp/polya_test.trace"
+                " && bin/polya_trace /tmp/polya_test.trace /dev/null";
+    int return_code = WEXITSTATUS(system(cmd));
+
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Program exited with %d instead of EXIT_SUCCESS",
+		 return_code);
+}
@@ -0,0 +1,144 @@
+/*
+ * Microbenchmark for the crypto miner's difficulty check.
+ *
+ * Compares the original bit-by-bit check with the word-level check of
+ * difficulty.h, on the digests of consecutive counter values, and relates
+ * both to the cost of hashing one nonce with the fastest single-buffer
+ * in-tree SHA-256 that this processor supports.
+ *
+ * Usage: check_bench [diff]   (default 25)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sha256.h"
+#include "difficulty.h"
+
+#define NDIGESTS 4096
+#define ROUNDS 4000
+
+/* The check as originally written, kept here as the reference. */
+static int check_bits(unsigned char *digest, size_t dsize, unsigned int diff) {
+    for(int i = 0; i < dsize; i++) {
+        for(unsigned char mask = 0x80; mask != 0; mask >>= 1) {
+            if(digest[i] & mask)
+                return 0;
+            if(--diff == 0)
+                return 1;
+        }
+    }
+    return 0;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned char digests[NDIGESTS][SHA256_DIGEST_SIZE];
+static uint32_t states[NDIGESTS][8];
+
+int main(int argc, char *argv[]) {
+    unsigned int diff = argc > 1 ? atoi(argv[1]) : 25;
+    unsigned char block[SHA256_BLOCK_SIZE];
+    volatile long sink = 0;
+    double t;
+
+    // Digests of consecutive counters look like those seen while mining.
+    for(int i = 0; i < NDIGESTS; i++) {
+        memcpy(states[i], sha256_initial_state, sizeof(states[i]));
+        memset(block, 0, sizeof(block));
+        memcpy(block, &i, sizeof(i));
+        sha256_pad(block, block, sizeof(i), sizeof(i));
+        sha256_compress(states[i], block, 1);
+        sha256_digest(states[i], digests[i]);
+    }
+
+    // The two checks must agree for every difficulty, including the edge cases.
+    for(unsigned int d = 0; d <= 8 * SHA256_DIGEST_SIZE + 4; d++) {
+        struct difficulty target;
+        difficulty_init(&target, d, SHA256_DIGEST_SIZE);
+        for(int i = 0; i < NDIGESTS; i++) {
+            unsigned char x[SHA256_DIGEST_SIZE];
+            // Clear a varying number of leading bits so that both outcomes occur.
+            memcpy(x, digests[i], sizeof(x));
+            for(int b = 0; b < (int)(i % 260) && b < 8 * SHA256_DIGEST_SIZE; b++)
+                x[b / 8] &= ~(0x80 >> (b % 8));
+            if(check_bits(x, sizeof(x), d) != difficulty_check_digest(&target, x)) {
+                fprintf(stderr, "Mismatch: diff %u, digest %d\n", d, i);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    struct difficulty target;
+    difficulty_init(&target, diff, SHA256_DIGEST_SIZE);
+    long n = (long)NDIGESTS * ROUNDS;
+
+    t = now();
+    for(int r = 0; r < ROUNDS; r++)
+        for(int i = 0; i < NDIGESTS; i++)
+            sink += check_bits(digests[i], SHA256_DIGEST_SIZE, diff);
+    double bits = (now() - t) / n * 1e9;
+
+    t = now();
+    for(int r = 0; r < ROUNDS; r++)
+        for(int i = 0; i < NDIGESTS; i++)
+            sink += difficulty_check_digest(&target, digests[i]);
+    double words = (now() - t) / n * 1e9;
+
+    t = now();
+    for(int r = 0; r < ROUNDS; r++)
+        for(int i = 0; i < NDIGESTS; i++)
+            sink += difficulty_check_state(&target, states[i]);
+    double state = (now() - t) / n * 1e9;
+
+    // Cost of hashing one nonce: one final block from a midstate, plus storing
+    // the digest, which the original check needs and the state check does not.
+    long nhash = n / 16;
+    uint32_t st[8];
+    unsigned char x[SHA256_DIGEST_SIZE];
+    memset(block, 0, sizeof(block));
+    sha256_pad(block, block, 40, 104);
+    t = now();
+    for(long i = 0; i < nhash; i++) {
+        memcpy(st, sha256_initial_state, sizeof(st));
+        memcpy(block + 32, &i, sizeof(i));
+        sha256_compress(st, block, 1);
+        sink += st[0];
+    }
+    double hash = (now() - t) / nhash * 1e9;
+    printf("compress 1 block (scalar) %7.2f ns\n", hash);
+    if(sha256_ni_supported()) {
+        t = now();
+        for(long i = 0; i < nhash; i++) {
+            memcpy(st, sha256_initial_state, sizeof(st));
+            memcpy(block + 32, &i, sizeof(i));
+            sha256_compress_ni(st, block, 1);
+            sink += st[0];
+        }
+        hash = (now() - t) / nhash * 1e9;
+        printf("compress 1 block (shani)  %7.2f ns\n", hash);
+    }
+    t = now();
+    for(long i = 0; i < nhash; i++) {
+        st[0] = i;
+        sha256_digest(st, x);
+        sink += x[3];
+    }
+    double store = (now() - t) / nhash * 1e9;
+
+    printf("difficulty %u, %ld checks, ns per nonce, share of the fastest hash:\n", diff, n);
+    printf("  store digest           %7.2f\n", store);
+    printf("  bit-by-bit check       %7.2f  (%.1f%% of per-nonce cost, with digest store)\n",
+           bits, 100 * (bits + store) / (hash + bits + store));
+    printf("  word check on digest   %7.2f  (%.1f%%, with digest store)\n",
+           words, 100 * (words + store) / (hash + words + store));
+    printf("  word check on state    %7.2f  (%.1f%%)\n",
+           state, 100 * state / (hash + state));
+    return sink == 42 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
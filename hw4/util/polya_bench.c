@@ -0,0 +1,294 @@
+/*
+ * Benchmark suite (make bench).
+ *
+ * Measures, and writes as JSON for comparison between versions:
+ *   roundtrip: the rate at which the master hands out trivial problems and
+ *     collects their results, for 1 to max_workers workers;
+ *   hash_rate: the rate at which each supported crypto miner backend hashes
+ *     nonces on one core, for a range of block and nonce sizes;
+ *   end_to_end: crypto miner blocks solved per second, at a fixed difficulty,
+ *     with max_workers workers (at least 2);
+ *   cancel_latency: in the same runs, the time from the master notifying a
+ *     worker to cancel to receiving that worker's result.
+ * Problems are generated from a fixed seed, so each run sees the same work.
+ * Protocol measurements are taken from the timestamps of the sf_* events that
+ * bin/polya prints on stderr, from the first problem sent to the last result
+ * received, so that starting the workers is not counted.  Each measurement is
+ * repeated, and the median is reported.
+ *
+ * Usage: polya_bench [-o file] [-n max_workers] [-r repeats] [-p trivial_probs]
+ *                    [-B blocks] [-d difficulty] [-S seed] [-N log2_nonces]
+ *
+ * Run from the directory that contains bin/polya and bin/polya_worker.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "polya.h"
+#include "miner.h"
+
+#define POLYA "bin/polya"
+
+static const char *backend_names[NUM_MINER_BACKENDS] = {
+    "auto", "gcrypt", "scalar", "shani", "avx2", "avx512"
+};
+
+static size_t bsizes[] = { 32, 64, 80, 128 };
+static size_t nsizes[] = { 4, 8, 16 };
+
+/*
+ * What is gathered from the events of one run of the master.
+ */
+struct run {
+    double first_send;          // Time of the first problem sent.
+    double last_result;         // Time of the last result received.
+    long results;               // Results received.
+    long solved;                // Results not marked failed.
+    double *cancels;            // Cancellation latencies, in seconds.
+    int ncancels, cancels_cap;
+};
+
+// Cancellations notified and not yet answered, by worker.
+#define MAX_PENDING 256
+static struct { int pid; double time; } pending[MAX_PENDING];
+static int npending;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double median(double *v, int n) {
+    qsort(v, n, sizeof(double), compare_double);
+    return n == 0 ? 0 : n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+static double quantile(double *sorted, int n, double q) {
+    int i = (int)(q * n);
+    return n == 0 ? 0 : sorted[i < n ? i : n - 1];
+}
+
+static void add_cancel(struct run *r, double latency) {
+    if(r->ncancels == r->cancels_cap) {
+        r->cancels_cap = r->cancels_cap ? 2 * r->cancels_cap : 64;
+        if((r->cancels = realloc(r->cancels, r->cancels_cap * sizeof(double))) == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    r->cancels[r->ncancels++] = latency;
+}
+
+static void parse_event(struct run *r, char *line) {
+    double t;
+    int n, pid, failed;
+    if(sscanf(line, "%lf: %n", &t, &n) != 1)
+        return;
+    line += n;
+    if(!strncmp(line, "send problem", 12)) {
+        if(r->first_send == 0)
+            r->first_send = t;
+    } else if(sscanf(line, "receive result %*s (failed = %d) from worker %d", &failed, &pid) == 2) {
+        r->results++;
+        r->solved += !failed;
+        r->last_result = t;
+        for(int i = 0; i < npending; i++) {
+            if(pending[i].pid == pid) {
+                add_cancel(r, t - pending[i].time);
+                pending[i] = pending[--npending];
+                break;
+            }
+        }
+    } else if(sscanf(line, "notify worker %d to cancel", &pid) == 1) {
+        if(npending < MAX_PENDING) {
+            pending[npending].pid = pid;
+            pending[npending++].time = t;
+        }
+    }
+}
+
+/*
+ * Run the master with the given arguments, gathering its events.
+ * @return 0 if it exited successfully, otherwise -1.
+ */
+static int run_polya(char *args[], struct run *r) {
+    int fds[2], status;
+    memset(r, 0, sizeof(*r));
+    npending = 0;
+    if(pipe(fds) < 0) {
+        perror("pipe");
+        exit(EXIT_FAILURE);
+    }
+    pid_t pid = fork();
+    if(pid < 0) {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+    if(pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        dup2(fds[1], STDERR_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        close(null);
+        execv(POLYA, args);
+        perror("exec " POLYA);
+        _exit(127);
+    }
+    close(fds[1]);
+    FILE *f = fdopen(fds[0], "r");
+    char *line = NULL;
+    size_t cap = 0;
+    while(getline(&line, &cap, f) > 0)
+        parse_event(r, line);
+    free(line);
+    fclose(f);
+    waitpid(pid, &status, 0);
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+        fprintf(stderr, "%s failed\n", POLYA);
+        return -1;
+    }
+    return 0;
+}
+
+static double run_seconds(struct run *r) {
+    return r->last_result > r->first_send ? r->last_result - r->first_send : 0;
+}
+
+static void usage(char *name) {
+    fprintf(stderr, "Usage: %s [-o file] [-n max_workers] [-r repeats] [-p trivial_probs]\n"
+            "       [-B blocks] [-d difficulty] [-S seed] [-N log2_nonces]\n", name);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    char *out = "bench.json";
+    int max_workers = 4, repeats = 3, nprobs = 20000, nblocks = 20, diff = 20, nonce_bits = 20;
+    unsigned int seed = 1;
+    int opt;
+    while((opt = getopt(argc, argv, "o:n:r:p:B:d:S:N:")) != -1) {
+        switch(opt) {
+        case 'o': out = optarg; break;
+        case 'n': max_workers = atoi(optarg); break;
+        case 'r': repeats = atoi(optarg); break;
+        case 'p': nprobs = atoi(optarg); break;
+        case 'B': nblocks = atoi(optarg); break;
+        case 'd': diff = atoi(optarg); break;
+        case 'S': seed = strtoul(optarg, NULL, 0); break;
+        case 'N': nonce_bits = atoi(optarg); break;
+        default: usage(argv[0]);
+        }
+    }
+    if(optind != argc || max_workers < 1 || repeats < 1 || nprobs < 1 || nblocks < 1
+       || diff < 1 || diff > 64 || nonce_bits < 1 || nonce_bits > 40)
+        usage(argv[0]);
+
+    FILE *f = fopen(out, "w");
+    if(f == NULL) {
+        perror(out);
+        return EXIT_FAILURE;
+    }
+    char ws[16], ps[16], bs[16], ds[16], ss[16];
+    double v[repeats];
+    struct run r;
+    snprintf(ps, sizeof(ps), "%d", nprobs);
+    snprintf(bs, sizeof(bs), "%d", nblocks);
+    snprintf(ds, sizeof(ds), "%d", diff);
+    snprintf(ss, sizeof(ss), "%u", seed);
+
+    fprintf(f, "{\n  \"version\": 1,\n  \"timestamp\": %ld,\n", (long)time(NULL));
+    fprintf(f, "  \"host\": { \"cpus\": %ld },\n", sysconf(_SC_NPROCESSORS_ONLN));
+    fprintf(f, "  \"params\": { \"max_workers\": %d, \"repeats\": %d, \"trivial_problems\": %d, "
+            "\"blocks\": %d, \"difficulty\": %d, \"seed\": %u, \"nonces\": %ld },\n",
+            max_workers, repeats, nprobs, nblocks, diff, seed, 1L << nonce_bits);
+
+    fprintf(f, "  \"roundtrip\": [");
+    for(int w = 1; w <= max_workers; w++) {
+        snprintf(ws, sizeof(ws), "%d", w);
+        char *args[] = { POLYA, "-w", ws, "-p", ps, "-t", "1", "-S", ss, NULL };
+        for(int i = 0; i < repeats; i++) {
+            if(run_polya(args, &r) < 0)
+                return EXIT_FAILURE;
+            v[i] = run_seconds(&r) > 0 ? r.results / run_seconds(&r) : 0;
+        }
+        double rate = median(v, repeats);
+        fprintf(stderr, "roundtrip: %d workers: %.0f problems/sec\n", w, rate);
+        fprintf(f, "%s\n    { \"workers\": %d, \"problems_per_sec\": %.1f }", w > 1 ? "," : "", w, rate);
+    }
+    fprintf(f, "\n  ],\n");
+
+    fprintf(f, "  \"hash_rate\": [");
+    int first = 1;
+    for(int b = MINER_BACKEND_AUTO + 1; b < NUM_MINER_BACKENDS; b++) {
+        if(!miner_backend_supported(b))
+            continue;
+        for(int i = 0; i < sizeof(bsizes) / sizeof(bsizes[0]); i++) {
+            for(int j = 0; j < sizeof(nsizes) / sizeof(nsizes[0]); j++) {
+                for(int k = 0; k < repeats; k++)
+                    v[k] = crypto_miner_hash_rate(b, bsizes[i], nsizes[j], 1L << nonce_bits);
+                double rate = median(v, repeats);
+                fprintf(stderr, "hash_rate: %s bsize %zu nsize %zu: %.0f hashes/sec\n",
+                        backend_names[b], bsizes[i], nsizes[j], rate);
+                fprintf(f, "%s\n    { \"backend\": \"%s\", \"bsize\": %zu, \"nsize\": %zu, "
+                        "\"hashes_per_sec\": %.0f }", first ? "" : ",", backend_names[b],
+                        bsizes[i], nsizes[j], rate);
+                first = 0;
+            }
+        }
+    }
+    fprintf(f, "\n  ],\n");
+
+    // Cancellation needs a second worker.
+    int w = max_workers > 1 ? max_workers : 2;
+    double *cancels = NULL;
+    int ncancels = 0;
+    double start = now();
+    snprintf(ws, sizeof(ws), "%d", w);
+    char *args[] = { POLYA, "-w", ws, "-p", bs, "-t", "2", "-d", ds, "-S", ss, NULL };
+    for(int i = 0; i < repeats; i++) {
+        if(run_polya(args, &r) < 0)
+            return EXIT_FAILURE;
+        v[i] = run_seconds(&r) > 0 ? r.solved / run_seconds(&r) : 0;
+        if((cancels = realloc(cancels, (ncancels + r.ncancels + 1) * sizeof(double))) == NULL) {
+            perror("realloc");
+            return EXIT_FAILURE;
+        }
+        memcpy(cancels + ncancels, r.cancels, r.ncancels * sizeof(double));
+        ncancels += r.ncancels;
+        free(r.cancels);
+    }
+    double rate = median(v, repeats);
+    fprintf(stderr, "end_to_end: %d workers, difficulty %d: %.2f blocks/sec (%.1f sec)\n",
+            w, diff, rate, now() - start);
+    fprintf(f, "  \"end_to_end\": { \"workers\": %d, \"difficulty\": %d, \"blocks_per_sec\": %.3f },\n",
+            w, diff, rate);
+
+    qsort(cancels, ncancels, sizeof(double), compare_double);
+    double sum = 0;
+    for(int i = 0; i < ncancels; i++)
+        sum += cancels[i];
+    fprintf(stderr, "cancel_latency: %d cancellations, p50 %.1f us, p99 %.1f us\n",
+            ncancels, quantile(cancels, ncancels, 0.5) * 1e6, quantile(cancels, ncancels, 0.99) * 1e6);
+    fprintf(f, "  \"cancel_latency\": { \"count\": %d, \"mean_us\": %.1f, \"p50_us\": %.1f, "
+            "\"p90_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f }\n}\n",
+            ncancels, ncancels ? sum / ncancels * 1e6 : 0,
+            quantile(cancels, ncancels, 0.5) * 1e6, quantile(cancels, ncancels, 0.9) * 1e6,
+            quantile(cancels, ncancels, 0.99) * 1e6,
+            ncancels ? cancels[ncancels - 1] * 1e6 : 0);
+    free(cancels);
+    fclose(f);
+    fprintf(stderr, "Results written to %s\n", out);
+    return EXIT_SUCCESS;
+}
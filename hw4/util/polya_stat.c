@@ -0,0 +1,238 @@
+/*
+ * Reader for the metrics segment of a running master (polya -M).
+ *
+ * Without -p, prints a table every interval (default 1 second) until the
+ * master exits: totals, the rate of results, percentiles of the time from
+ * sending a problem to receiving its result, and for each worker its state,
+ * the hash rate of its latest solve and the share of the interval it spent
+ * busy with a problem.
+ *
+ * With -p, prints one snapshot in the Prometheus text exposition format and
+ * exits, so that it can be run from a textfile collector or a CGI wrapper.
+ *
+ * Usage: polya_stat [-p] [-i secs] master_pid
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "polya.h"
+#include "stats.h"
+
+static const char *state_names[STATS_NSTATES] = {
+    "none", "started", "idle", "continued", "running", "stopped", "exited", "aborted"
+};
+
+static uint64_t now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t get(_Atomic uint64_t *p) {
+    return atomic_load_explicit(p, memory_order_relaxed);
+}
+
+static struct stats_segment *map_segment(int pid) {
+    char name[64];
+    struct stats_segment *s;
+    snprintf(name, sizeof(name), STATS_NAME_FMT, pid);
+    int fd = shm_open(name, O_RDONLY, 0);
+    if(fd < 0) {
+        fprintf(stderr, "No metrics segment %s (was the master started with -M?)\n", name);
+        return NULL;
+    }
+    s = mmap(NULL, sizeof(*s), PROT_READ, MAP_SHARED, fd, 0);
+    if(s == MAP_FAILED) {
+        perror("mmap");
+        close(fd);
+        return NULL;
+    }
+    if(s->magic != STATS_MAGIC || s->version != STATS_VERSION) {
+        fprintf(stderr, "%s is not a version %d metrics segment\n", name, STATS_VERSION);
+        munmap(s, sizeof(*s));
+        close(fd);
+        return NULL;
+    }
+    size_t size = STATS_SEGMENT_SIZE(s->nworkers);
+    munmap(s, sizeof(*s));
+    s = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(s == MAP_FAILED) {
+        perror("mmap");
+        return NULL;
+    }
+    return s;
+}
+
+/*
+ * Smallest value such that a fraction q of the histogram lies below it,
+ * to within the width of a bucket.
+ */
+static uint64_t percentile(uint64_t *buckets, uint64_t count, double q) {
+    uint64_t want = (uint64_t)(q * count), seen = 0;
+    for(int b = 0; b < STATS_HIST_BUCKETS; b++) {
+        seen += buckets[b];
+        if(seen > want)
+            return stats_bucket_value(b);
+    }
+    return 0;
+}
+
+/* Time a worker has spent busy with problems, counting the current stay. */
+static uint64_t busy_time(struct stats_worker *sw, uint64_t t) {
+    uint64_t busy = get(&sw->state_time[WORKER_CONTINUED]) + get(&sw->state_time[WORKER_RUNNING]);
+    int state = atomic_load_explicit(&sw->state, memory_order_relaxed);
+    uint64_t since = get(&sw->state_since);
+    if((state == WORKER_CONTINUED || state == WORKER_RUNNING) && since < t)
+        busy += t - since;
+    return busy;
+}
+
+static void print_prometheus(struct stats_segment *s) {
+    uint64_t t = now();
+    uint64_t dispatched = get(&s->dispatched), solved = get(&s->solved);
+    uint64_t failed = get(&s->failed), canceled = get(&s->canceled);
+
+    printf("# HELP polya_uptime_seconds Time since the master started.\n");
+    printf("# TYPE polya_uptime_seconds gauge\n");
+    printf("polya_uptime_seconds %.3f\n", (t - s->start) / 1e9);
+    printf("# HELP polya_problems_total Problems sent to workers, and their results.\n");
+    printf("# TYPE polya_problems_total counter\n");
+    printf("polya_problems_total{outcome=\"dispatched\"} %lu\n", dispatched);
+    printf("polya_problems_total{outcome=\"solved\"} %lu\n", solved);
+    printf("polya_problems_total{outcome=\"failed\"} %lu\n", failed);
+    printf("polya_problems_total{outcome=\"canceled\"} %lu\n", canceled);
+    printf("# HELP polya_in_flight Problems sent to workers and not yet answered.\n");
+    printf("# TYPE polya_in_flight gauge\n");
+    printf("polya_in_flight %lu\n", dispatched - solved - failed - canceled);
+
+    // The count is read first: it is updated last, so the buckets add up to
+    // at least as much.
+    uint64_t count = get(&s->latency.count), cum = 0;
+    int b = 0;
+    printf("# HELP polya_solve_seconds Time from sending a problem to receiving its result.\n");
+    printf("# TYPE polya_solve_seconds histogram\n");
+    // One Prometheus bucket per power of two from 1 us to about 4.6 hours.
+    for(int p = 10; p <= 44; p++) {
+        uint64_t bound = (uint64_t)1 << p;
+        for(; b < STATS_HIST_BUCKETS && stats_bucket_value(b) < bound; b++)
+            cum += get(&s->latency.buckets[b]);
+        printf("polya_solve_seconds_bucket{le=\"%.9g\"} %lu\n", bound / 1e9, cum < count ? cum : count);
+    }
+    printf("polya_solve_seconds_bucket{le=\"+Inf\"} %lu\n", count);
+    printf("polya_solve_seconds_sum %.9f\n", get(&s->latency.sum) / 1e9);
+    printf("polya_solve_seconds_count %lu\n", count);
+
+    printf("# HELP polya_worker_hash_rate Hashes per second in the latest solve of a worker.\n");
+    printf("# TYPE polya_worker_hash_rate gauge\n");
+    for(int i = 0; i < s->nworkers; i++)
+        printf("polya_worker_hash_rate{worker=\"%d\"} %lu\n", i, get(&s->workers[i].last_rate));
+    printf("# HELP polya_worker_hashes_total Hashes done by a worker.\n");
+    printf("# TYPE polya_worker_hashes_total counter\n");
+    for(int i = 0; i < s->nworkers; i++)
+        printf("polya_worker_hashes_total{worker=\"%d\"} %lu\n", i, get(&s->workers[i].hashes));
+    printf("# HELP polya_worker_state_seconds_total Time a worker has spent in each state.\n");
+    printf("# TYPE polya_worker_state_seconds_total counter\n");
+    for(int i = 0; i < s->nworkers; i++) {
+        struct stats_worker *sw = &s->workers[i];
+        int state = atomic_load_explicit(&sw->state, memory_order_relaxed);
+        uint64_t since = get(&sw->state_since);
+        for(int st = WORKER_STARTED; st < STATS_NSTATES; st++) {
+            uint64_t v = get(&sw->state_time[st]);
+            if(st == state && since < t)
+                v += t - since;
+            printf("polya_worker_state_seconds_total{worker=\"%d\",state=\"%s\"} %.6f\n",
+                   i, state_names[st], v / 1e9);
+        }
+    }
+}
+
+static void print_table(struct stats_segment *s, uint64_t *prev_busy, uint64_t *prev_solved,
+                        uint64_t *prev_t) {
+    uint64_t t = now();
+    uint64_t buckets[STATS_HIST_BUCKETS];
+    uint64_t count = get(&s->latency.count);
+    for(int b = 0; b < STATS_HIST_BUCKETS; b++)
+        buckets[b] = get(&s->latency.buckets[b]);
+    uint64_t dispatched = get(&s->dispatched), solved = get(&s->solved);
+    uint64_t failed = get(&s->failed), canceled = get(&s->canceled);
+    double interval = (t - *prev_t) / 1e9;
+
+    printf("\n%.1fs  sent %lu  solved %lu  failed %lu  canceled %lu  in flight %lu  solved/s %.1f\n",
+           (t - s->start) / 1e9, dispatched, solved, failed, canceled,
+           dispatched - solved - failed - canceled,
+           interval > 0 ? (solved - *prev_solved) / interval : 0.0);
+    if(count > 0)
+        printf("latency ms  p50 %.3f  p90 %.3f  p99 %.3f  max %.3f  mean %.3f\n",
+               percentile(buckets, count, 0.5) / 1e6, percentile(buckets, count, 0.9) / 1e6,
+               percentile(buckets, count, 0.99) / 1e6, get(&s->latency.max) / 1e6,
+               get(&s->latency.sum) / 1e6 / count);
+    printf("%6s %8s %-10s %8s %12s %6s\n", "worker", "pid", "state", "results", "H/s", "busy%");
+    for(int i = 0; i < s->nworkers; i++) {
+        struct stats_worker *sw = &s->workers[i];
+        int state = atomic_load_explicit(&sw->state, memory_order_relaxed);
+        uint64_t busy = busy_time(sw, t);
+        printf("%6d %8d %-10s %8lu %12lu %6.1f\n", i,
+               atomic_load_explicit(&sw->pid, memory_order_relaxed),
+               state >= 0 && state < STATS_NSTATES ? state_names[state] : "?",
+               get(&sw->results), get(&sw->last_rate),
+               t > *prev_t ? 100.0 * (busy - prev_busy[i]) / (t - *prev_t) : 0.0);
+        prev_busy[i] = busy;
+    }
+    fflush(stdout);
+    *prev_solved = solved;
+    *prev_t = t;
+}
+
+int main(int argc, char *argv[]) {
+    int prometheus = 0, opt;
+    double interval = 1.0;
+    while((opt = getopt(argc, argv, "pi:")) != -1) {
+        switch(opt) {
+        case 'p':
+            prometheus = 1;
+            break;
+        case 'i':
+            interval = atof(optarg);
+            break;
+        default:
+            goto usage;
+        }
+    }
+    if(optind != argc - 1 || interval <= 0)
+        goto usage;
+    int pid = atoi(argv[optind]);
+    struct stats_segment *s = map_segment(pid);
+    if(s == NULL)
+        return EXIT_FAILURE;
+    if(prometheus) {
+        print_prometheus(s);
+        return EXIT_SUCCESS;
+    }
+
+    uint64_t *prev_busy = calloc(s->nworkers, sizeof(uint64_t));
+    uint64_t prev_solved = 0, prev_t = s->start;
+    if(prev_busy == NULL) {
+        perror("calloc");
+        return EXIT_FAILURE;
+    }
+    struct timespec ts = { (time_t)interval, (long)((interval - (time_t)interval) * 1e9) };
+    // The segment outlives an unlink by the master, so watch the master itself.
+    while(kill(pid, 0) == 0) {
+        print_table(s, prev_busy, &prev_solved, &prev_t);
+        nanosleep(&ts, NULL);
+    }
+    print_table(s, prev_busy, &prev_solved, &prev_t);
+    return EXIT_SUCCESS;
+
+usage:
+    fprintf(stderr, "Usage: %s [-p] [-i secs] master_pid\n", argv[0]);
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,262 @@
+/*
+ * Converter from a trace recorded by the master (polya -R) to Chrome trace
+ * JSON, which can be opened in Perfetto (ui.perfetto.dev) or chrome://tracing.
+ *
+ * Each worker gets a track, on which each problem it was given is a slice from
+ * being sent to its result being received, divided into the stages
+ *   dispatch: sent to continued (SIGCONT or wake),
+ *   wakeup: continued to seen running,
+ *   solve: running to stopped,
+ *   collect: stopped to the result being received,
+ * so that gaps between slices are time the worker sat idle.  Cancellations
+ * are shown as async slices from the notice to the worker's result, and the
+ * life of each problem, from construction to the result that solved it, as an
+ * async slice too.  Construction, variants and posting of results are instants
+ * on the master's track.  A summary of the stages is printed on stderr.
+ *
+ * Usage: polya_trace trace_file [json_file]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "polya.h"
+#include "trace.h"
+
+/* Stages of a problem on a worker. */
+#define STAGE_DISPATCH 0
+#define STAGE_WAKEUP   1
+#define STAGE_SOLVE    2
+#define STAGE_COLLECT  3
+#define NSTAGES        4
+
+static const char *stage_names[NSTAGES] = { "dispatch", "wakeup", "solve", "collect" };
+
+/*
+ * What is known about the problem a worker is on.
+ */
+struct worker_track {
+    int pid;
+    int prob, var;
+    uint64_t sent;                  // 0 if the worker has no problem.
+    uint64_t marks[NSTAGES + 1];    // Start of each stage, 0 if not seen.
+    uint64_t canceled;              // When the worker was notified to cancel, or 0.
+};
+
+static struct {
+    long count;
+    double total, max;
+} stage_stats[NSTAGES];
+
+static FILE *out;
+static int nevents;
+static uint64_t start;
+static int master_pid;
+
+static struct trace_record *records;
+
+static int compare_records(const void *a, const void *b) {
+    const struct trace_record *x = a, *y = b;
+    if(x->time != y->time)
+        return x->time < y->time ? -1 : 1;
+    // Records made at the same time stay in the order they were made.
+    return x < y ? -1 : x > y;
+}
+
+static double us(uint64_t t) {
+    return t > start ? (t - start) / 1e3 : 0;
+}
+
+/* Start an event object, with the fields common to all. */
+static void event(const char *ph, const char *name, int tid, uint64_t t) {
+    fprintf(out, "%s\n{\"ph\":\"%s\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f",
+            nevents++ ? "," : "", ph, name, master_pid, tid, us(t));
+}
+
+static void slice(const char *name, int tid, uint64_t from, uint64_t to, int prob, int var) {
+    event("X", name, tid, from);
+    fprintf(out, ",\"dur\":%.3f,\"args\":{\"problem\":%d,\"variant\":%d}}",
+            (to - from) / 1e3, prob, var);
+}
+
+/*
+ * Emit the slices of a worker's problem, which has just ended with its result.
+ */
+static void finish_problem(struct worker_track *wt, int tid, uint64_t t, int failed) {
+    char name[64];
+    snprintf(name, sizeof(name), "problem %d/%d", wt->prob, wt->var);
+    event("X", name, tid, wt->sent);
+    fprintf(out, ",\"dur\":%.3f,\"args\":{\"problem\":%d,\"variant\":%d,\"failed\":%d,\"canceled\":%d}}",
+            (t - wt->sent) / 1e3, wt->prob, wt->var, failed, wt->canceled != 0);
+    // A stage whose start was not seen is merged into the one before it.
+    wt->marks[STAGE_DISPATCH] = wt->sent;
+    wt->marks[NSTAGES] = t;
+    for(int s = 0; s < NSTAGES; s++) {
+        if(wt->marks[s] == 0)
+            continue;
+        int next = s + 1;
+        while(wt->marks[next] == 0)
+            next++;
+        uint64_t end = wt->marks[next];
+        if(end < wt->marks[s])
+            continue;
+        slice(stage_names[s], tid, wt->marks[s], end, wt->prob, wt->var);
+        double d = (end - wt->marks[s]) / 1e3;
+        stage_stats[s].count++;
+        stage_stats[s].total += d;
+        if(d > stage_stats[s].max)
+            stage_stats[s].max = d;
+    }
+    wt->sent = 0;
+}
+
+int main(int argc, char *argv[]) {
+    struct trace_header h;
+    struct stat st;
+    if(argc < 2 || argc > 3) {
+        fprintf(stderr, "Usage: %s trace_file [json_file]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    FILE *in = fopen(argv[1], "r");
+    if(in == NULL || fstat(fileno(in), &st) < 0) {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+    if(fread(&h, sizeof(h), 1, in) != 1 || h.magic != TRACE_MAGIC || h.version != TRACE_VERSION) {
+        fprintf(stderr, "%s is not a version %d trace\n", argv[1], TRACE_VERSION);
+        return EXIT_FAILURE;
+    }
+    // The file may have been cut short, or the count may include dropped events.
+    uint64_t n = atomic_load(&h.nrecords);
+    uint64_t fit = (st.st_size - sizeof(h)) / sizeof(struct trace_record);
+    if(n > fit)
+        n = fit;
+    if((records = malloc(n * sizeof(struct trace_record) + 1)) == NULL
+       || fread(records, sizeof(struct trace_record), n, in) != n) {
+        fprintf(stderr, "Can't read %lu records from %s\n", n, argv[1]);
+        return EXIT_FAILURE;
+    }
+    fclose(in);
+    qsort(records, n, sizeof(struct trace_record), compare_records);
+    out = argc == 3 ? fopen(argv[2], "w") : stdout;
+    if(out == NULL) {
+        perror(argv[2]);
+        return EXIT_FAILURE;
+    }
+    start = h.start_mono;
+    master_pid = h.master_pid;
+
+    int nworkers = h.nworkers;
+    struct worker_track *workers = calloc(nworkers > 0 ? nworkers : 1, sizeof(struct worker_track));
+    if(workers == NULL) {
+        perror("calloc");
+        return EXIT_FAILURE;
+    }
+    uint64_t last = start;
+    long nproblems = 0, nsolved = 0;
+
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"master_pid\":%d,\"start_realtime_ns\":%lu},"
+            "\"traceEvents\":[", master_pid, h.start_real);
+    for(uint64_t i = 0; i < n; i++) {
+        struct trace_record *r = &records[i];
+        int tid = r->worker + 1;
+        struct worker_track *wt = r->worker >= 0 && r->worker < nworkers ? &workers[r->worker] : NULL;
+        last = r->time;
+        if(r->worker >= nworkers || (r->worker >= 0 && r->event < TRACE_SEND))
+            continue;
+        if(wt != NULL)
+            wt->pid = r->pid;
+        switch(r->event) {
+        case TRACE_CONSTRUCT:
+            nproblems++;
+            event("i", "construct", 0, r->time);
+            fprintf(out, ",\"s\":\"t\",\"args\":{\"problem\":%d,\"type\":%d}}", r->prob, r->arg);
+            event("b", "problem", 0, r->time);
+            fprintf(out, ",\"cat\":\"problem\",\"id\":%d,\"args\":{\"problem\":%d}}", r->prob, r->prob);
+            break;
+        case TRACE_VARY:
+            event("i", "vary", 0, r->time);
+            fprintf(out, ",\"s\":\"t\",\"args\":{\"problem\":%d,\"variant\":%d}}", r->prob, r->var);
+            break;
+        case TRACE_SEND:
+            if(wt == NULL)
+                break;
+            memset(wt->marks, 0, sizeof(wt->marks));
+            wt->sent = r->time;
+            wt->prob = r->prob;
+            wt->var = r->var;
+            break;
+        case TRACE_CONTINUE:
+            if(wt != NULL && wt->sent)
+                wt->marks[STAGE_WAKEUP] = r->time;
+            break;
+        case TRACE_STATE:
+            if(wt == NULL || !wt->sent)
+                break;
+            if(r->arg == WORKER_RUNNING)
+                wt->marks[STAGE_SOLVE] = r->time;
+            else if(r->arg == WORKER_STOPPED)
+                wt->marks[STAGE_COLLECT] = r->time;
+            break;
+        case TRACE_RESULT:
+            if(wt != NULL && wt->sent)
+                finish_problem(wt, tid, r->time, r->arg);
+            if(wt != NULL)
+                wt->canceled = 0;
+            break;
+        case TRACE_CANCEL:
+            if(wt == NULL)
+                break;
+            wt->canceled = r->time;
+            event("b", "cancel", tid, r->time);
+            fprintf(out, ",\"cat\":\"cancel\",\"id\":\"w%d\",\"args\":{\"problem\":%d}}", r->worker, r->prob);
+            break;
+        case TRACE_CANCEL_ACK:
+            if(wt == NULL || !wt->canceled)
+                break;
+            event("e", "cancel", tid, r->time);
+            fprintf(out, ",\"cat\":\"cancel\",\"id\":\"w%d\"}", r->worker);
+            break;
+        case TRACE_POST:
+            event("i", r->arg == 0 ? "solved" : "post", 0, r->time);
+            fprintf(out, ",\"s\":\"t\",\"args\":{\"problem\":%d,\"variant\":%d,\"worker\":%d}}",
+                    r->prob, r->var, r->worker);
+            if(r->arg == 0) {
+                nsolved++;
+                event("e", "problem", 0, r->time);
+                fprintf(out, ",\"cat\":\"problem\",\"id\":%d}", r->prob);
+            }
+            break;
+        }
+    }
+
+    event("M", "process_name", 0, start);
+    fprintf(out, ",\"args\":{\"name\":\"polya master %d\"}}", master_pid);
+    event("M", "thread_name", 0, start);
+    fprintf(out, ",\"args\":{\"name\":\"master\"}}");
+    for(int w = 0; w < nworkers; w++) {
+        event("M", "thread_name", w + 1, start);
+        fprintf(out, ",\"args\":{\"name\":\"worker %d (%d)\"}}", w, workers[w].pid);
+        event("M", "thread_sort_index", w + 1, start);
+        fprintf(out, ",\"args\":{\"sort_index\":%d}}", w + 1);
+    }
+    fprintf(out, "\n]}\n");
+    if(out != stdout)
+        fclose(out);
+
+    fprintf(stderr, "%lu events over %.3f ms, %d workers, %ld problems, %ld solved",
+            n, us(last) / 1e3, nworkers, nproblems, nsolved);
+    if(atomic_load(&h.nrecords) > n)
+        fprintf(stderr, " (%lu events missing)", atomic_load(&h.nrecords) - n);
+    fprintf(stderr, "\n%-10s %8s %12s %12s\n", "stage", "count", "mean us", "max us");
+    for(int s = 0; s < NSTAGES; s++) {
+        fprintf(stderr, "%-10s %8ld %12.1f %12.1f\n", stage_names[s], stage_stats[s].count,
+                stage_stats[s].count ? stage_stats[s].total / stage_stats[s].count : 0.0,
+                stage_stats[s].max);
+    }
+    free(records);
+    free(workers);
+    return EXIT_SUCCESS;
+}